@@ -2,7 +2,10 @@ import streamlit as st
 import pandas as pd
 import subprocess
 import os
+import glob
 import json
+import csv
+import tempfile
 import hashlib
 import time
 from datetime import datetime
@@ -58,8 +61,13 @@ def admin_delete_user(username):
         del users[username]
         save_users(users)
         user_file = get_user_file(username)
+        # Sidecars (<file>.archive, .versions, .snap, ...) go too, so a new
+        # user with the same name starts empty.
+        paths = glob.glob(glob.escape(user_file) + ".*")
         if os.path.exists(user_file):
-            os.remove(user_file)
+            paths.append(user_file)
+        for path in paths:
+            os.remove(path)
         return True, f"User '{username}' deleted successfully."
     return False, "User not found."
 
@@ -84,52 +92,65 @@ def run_backend(args, username):
     except FileNotFoundError:
         return "Error: Backend executable not found. Please compile main.c first."
 
-def load_data(username):
-    user_file = get_user_file(username)
-    if not os.path.exists(user_file):
-        return pd.DataFrame(columns=["ID", "Day", "Month", "Year", "Amount", "Type", "Category", "Description"])
-    
-    data = []
-    with open(user_file, "r") as f:
-        for line in f:
-            parts = line.strip().split()
-            if len(parts) >= 8:
-                desc = " ".join(parts[7:])
-                data.append({
+COLUMNS = ["ID", "Day", "Month", "Year", "Amount", "Type", "Category", "Description"]
+
+# Goes through the backend's export so archived rows are included along
+# with the live data file.
+def export_rows(username):
+    fd, path = tempfile.mkstemp(suffix=".tsv")
+    os.close(fd)
+    rows = []
+    try:
+        run_backend(["export", path], username)
+        with open(path, "r", newline="") as f:
+            reader = csv.reader(f, delimiter="\t")
+            next(reader, None)
+            for parts in reader:
+                if len(parts) != 6:
+                    continue
+                year, month, day = parts[1].split("-")
+                rows.append({
                     "ID": int(parts[0]),
-                    "Day": int(parts[1]),
-                    "Month": int(parts[2]),
-                    "Year": int(parts[3]),
-                    "Amount": float(parts[4]),
-                    "Type": parts[5],
-                    "Category": parts[6],
-                    "Description": desc
+                    "Day": int(day),
+                    "Month": int(month),
+                    "Year": int(year),
+                    "Amount": float(parts[2]),
+                    "Type": parts[3],
+                    "Category": parts[4],
+                    "Description": parts[5]
                 })
-    return pd.DataFrame(data)
+    finally:
+        os.remove(path)
+    return rows
+
+def load_data(username):
+    return pd.DataFrame(export_rows(username), columns=COLUMNS)
+
+def load_sorted_data(username, order):
+    output = run_backend(["list", f"--order={order}", "--format=tsv"], username)
+    data = []
+    for line in output.split('\n')[1:]:
+        parts = line.split('\t')
+        if len(parts) == 8 and not line.startswith('#'):
+            data.append({
+                "ID": int(parts[0]),
+                "Day": int(parts[1]),
+                "Month": int(parts[2]),
+                "Year": int(parts[3]),
+                "Amount": float(parts[4]),
+                "Type": parts[5],
+                "Category": parts[6],
+                "Description": parts[7]
+            })
+    return pd.DataFrame(data, columns=COLUMNS)
 
 def load_all_data():
     users = load_users()
     all_data = []
     
     for username in users.keys():
-        user_file = get_user_file(username)
-        if os.path.exists(user_file):
-            with open(user_file, "r") as f:
-                for line in f:
-                    parts = line.strip().split()
-                    if len(parts) >= 8:
-                        desc = " ".join(parts[7:])
-                        all_data.append({
-                            "User": username,
-                            "ID": int(parts[0]),
-                            "Day": int(parts[1]),
-                            "Month": int(parts[2]),
-                            "Year": int(parts[3]),
-                            "Amount": float(parts[4]),
-                            "Type": parts[5],
-                            "Category": parts[6],
-                            "Description": desc
-                        })
+        for row in export_rows(username):
+            all_data.append({"User": username, **row})
     return pd.DataFrame(all_data)
 
 def clean_backend_output(output):
@@ -410,14 +431,14 @@ else:
                 col1, col2 = st.columns(2)
                 
                 if col1.button("Sort by Amount"):
-                    output = run_backend(["sort_amount"], st.session_state['username'])
+                    st.session_state['sort_order'] = "amount"
                     st.toast("✅ Transactions sorted by amount!", icon="✅")
                     st.session_state['show_sorted'] = True
                     time.sleep(0.5)
                     st.rerun()
                     
                 if col2.button("Sort by Date"):
-                    output = run_backend(["sort_date"], st.session_state['username'])
+                    st.session_state['sort_order'] = "date"
                     st.toast("✅ Transactions sorted by date!", icon="✅")
                     st.session_state['show_sorted'] = True
                     time.sleep(0.5)
@@ -426,7 +447,7 @@ else:
                 if st.session_state.get('show_sorted', False):
                     st.divider()
                     st.write("### Sorted Transactions")
-                    df_sorted = load_data(st.session_state['username'])
+                    df_sorted = load_sorted_data(st.session_state['username'], st.session_state.get('sort_order', "id"))
                     st.dataframe(df_sorted, use_container_width=True)
                     
             with tab3:
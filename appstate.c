@@ -0,0 +1,178 @@
+#include "appstate.h"
+#include "file_ops.h"
+#include "snapshot.h"
+#include "viewstore.h"
+#include "budget.h"
+#include "sketch.h"
+#include "metrics.h"
+#include "archive.h"
+
+void initAppState(AppState* s, char* filename) {
+    s->filename = filename;
+    s->head = NULL;
+    s->bstRoot = NULL;
+    s->undoStack = NULL;
+    s->recurringQueue = createQueue();
+    s->loaded = 0;
+    s->count = 0;
+    s->totalIncome = 0;
+    s->totalExpense = 0;
+    s->digest = 0;
+    s->generation = 0;
+    s->journalLength = 0;
+    s->fromSnapshot = 0;
+    s->snapRows = NULL;
+    s->snapOrder = NULL;
+    s->snapCount = 0;
+    s->snapAdds = 0;
+    memset(&s->amountView, 0, sizeof(SortedView));
+    memset(&s->dateView, 0, sizeof(SortedView));
+    s->budgets = NULL;
+    s->sketches = NULL;
+    memset(&s->fingerprints, 0, sizeof(FingerprintIndex));
+    s->deferSaves = 0;
+    s->dirty = 0;
+    s->saveFailed = 0;
+}
+
+int isLoaded(AppState* s, int what) {
+    return (s->loaded & what) == what;
+}
+
+void rebuildIndex(AppState* s) {
+    freeBST(s->bstRoot);
+    s->bstRoot = NULL;
+    Node* temp = s->head;
+    while (temp != NULL) {
+        s->bstRoot = insertBST(s->bstRoot, temp->data);
+        temp = temp->next;
+    }
+}
+
+static uint64_t fnv(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Ids are unique, so XOR-ing row hashes gives a digest of the rows that
+// adds and removals update in O(1).
+uint64_t rowDigest(const Transaction* t) {
+    int fields[4] = {t->id, t->date.day, t->date.month, t->date.year};
+    long long cents = (long long)(t->amount * 100 + (t->amount < 0 ? -0.5 : 0.5));
+    uint64_t h = 14695981039346656037ULL;
+    h = fnv(h, fields, sizeof(fields));
+    h = fnv(h, &cents, sizeof(cents));
+    h = fnv(h, t->type, strlen(t->type) + 1);
+    h = fnv(h, t->category, strlen(t->category) + 1);
+    return fnv(h, t->description, strlen(t->description) + 1);
+}
+
+void applyTotals(AppState* s, const Transaction* t, int sign) {
+    s->count += sign;
+    s->digest ^= rowDigest(t);
+    if (strcmp(t->type, "Income") == 0) {
+        s->totalIncome += sign * t->amount;
+    } else if (strcmp(t->type, "Expense") == 0) {
+        s->totalExpense += sign * t->amount;
+    }
+}
+
+void dropSnapshotIndex(AppState* s) {
+    free(s->snapRows);
+    free(s->snapOrder);
+    s->snapRows = NULL;
+    s->snapOrder = NULL;
+    s->snapCount = 0;
+    s->snapAdds = 0;
+}
+
+void ensureLoaded(AppState* s, int needs) {
+    if (needs & (NEED_INDEX | NEED_VIEWS | NEED_BUDGETS | NEED_FINGERPRINTS)) needs |= NEED_TRANSACTIONS;
+    double start = metricsStart();
+
+    if ((needs & NEED_TRANSACTIONS) && !(s->loaded & NEED_TRANSACTIONS)) {
+        settleArchive(s->filename);
+        if (!loadSnapshot(s)) {
+            loadFromFile(&s->head, s->filename);
+            for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+                applyTotals(s, &temp->data, 1);
+            }
+            s->generation = currentGeneration(s->filename, &s->journalLength);
+        }
+        s->loaded |= NEED_TRANSACTIONS;
+    }
+    if ((needs & NEED_INDEX) && !(s->loaded & NEED_INDEX)) {
+        metricsStop(PHASE_LOAD, start);
+        double indexStart = metricsStart();
+        if (s->snapRows) buildIndexFromSnapshot(s);
+        else rebuildIndex(s);
+        s->loaded |= NEED_INDEX;
+        metricsStop(PHASE_INDEX, indexStart);
+        start = metricsStart();
+    }
+    // Stale views are only rebuilt in memory here, so a read never rewrites
+    // the sidecar; the next write that changes a row saves them.
+    if ((needs & NEED_VIEWS) && !(s->loaded & NEED_VIEWS)) {
+        if (!loadViews(s)) rebuildViews(s);
+        s->loaded |= NEED_VIEWS;
+    }
+    if ((needs & NEED_BUDGETS) && !(s->loaded & NEED_BUDGETS)) {
+        loadBudgets(s);
+        s->loaded |= NEED_BUDGETS;
+    }
+    if ((needs & NEED_SKETCHES) && !(s->loaded & NEED_SKETCHES)) {
+        loadSketches(s);
+        s->loaded |= NEED_SKETCHES;
+    }
+    if ((needs & NEED_FINGERPRINTS) && !(s->loaded & NEED_FINGERPRINTS)) {
+        char path[256];
+        sidecarPath(path, sizeof(path), s->filename, "fingerprints");
+        int stored = readFingerprints(&s->fingerprints, path, s->generation, fileSize(s->filename));
+        if (!stored) {
+            initFingerprints(&s->fingerprints, s->count);
+            for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+                fingerprintAdd(&s->fingerprints, &temp->data);
+            }
+        }
+        s->loaded |= NEED_FINGERPRINTS;
+        if (!stored) saveFingerprints(s);
+    }
+    if ((needs & NEED_UNDO) && !(s->loaded & NEED_UNDO)) {
+        loadStack(&s->undoStack, "undo_stack.txt");
+        s->loaded |= NEED_UNDO;
+    }
+    if ((needs & NEED_RECURRING) && !(s->loaded & NEED_RECURRING)) {
+        loadQueue(s->recurringQueue, "recurring.txt");
+        s->loaded |= NEED_RECURRING;
+    }
+    metricsStop(PHASE_LOAD, start);
+}
+
+void saveFingerprints(AppState* s) {
+    if (!isLoaded(s, NEED_FINGERPRINTS)) return;
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "fingerprints");
+    writeFingerprints(&s->fingerprints, path, s->generation, fileSize(s->filename));
+}
+
+void freeAppState(AppState* s) {
+    freeList(s->head);
+    freeBST(s->bstRoot);
+    freeStack(s->undoStack);
+    freeQueue(s->recurringQueue);
+    dropSnapshotIndex(s);
+    freeView(&s->amountView);
+    freeView(&s->dateView);
+    freeBudgets(s);
+    freeSketches(s);
+    freeFingerprints(&s->fingerprints);
+    s->head = NULL;
+    s->bstRoot = NULL;
+    s->undoStack = NULL;
+    s->recurringQueue = NULL;
+    s->loaded = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef APPSTATE_H
+#define APPSTATE_H
+
+#include "common.h"
+#include "linkedlist.h"
+#include "stack.h"
+#include "queue.h"
+#include "bst.h"
+#include "views.h"
+#include "fingerprint.h"
+#include <stdint.h>
+
+#define NEED_TRANSACTIONS 1
+#define NEED_INDEX 2
+#define NEED_UNDO 4
+#define NEED_RECURRING 8
+#define NEED_VIEWS 16
+#define NEED_BUDGETS 32
+#define NEED_FINGERPRINTS 64
+#define NEED_SKETCHES 128
+#define NEED_ALL (NEED_TRANSACTIONS | NEED_INDEX | NEED_UNDO | NEED_RECURRING | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES)
+
+typedef struct BudgetBook BudgetBook;
+typedef struct SketchBook SketchBook;
+
+// Backend state for one account. Each subsystem is loaded the first time
+// a command asks for it, so commands that never touch transactions do not
+// pay for reading them.
+typedef struct {
+    char* filename;
+    Node* head;
+    BSTNode* bstRoot;
+    StackNode* undoStack;
+    Queue* recurringQueue;
+    int loaded;
+
+    // Running aggregates, kept in step with every mutation. The digest is
+    // the XOR of every row's rowDigest().
+    int count;
+    double totalIncome;
+    double totalExpense;
+    uint64_t digest;
+
+    // Change tracking for snapshot + journal recovery (see snapshot.h).
+    long generation;
+    int journalLength;
+    int fromSnapshot;
+    Transaction* snapRows;
+    int* snapOrder;
+    int snapCount;
+    int snapAdds;
+
+    SortedView amountView;
+    SortedView dateView;
+
+    BudgetBook* budgets;
+    SketchBook* sketches;
+    FingerprintIndex fingerprints;
+
+    // Set while a write-behind worker owns the full-file saves.
+    int deferSaves;
+    int dirty;
+
+    // Set when a data file save made by a command fails; callers clear it.
+    int saveFailed;
+} AppState;
+
+void initAppState(AppState* s, char* filename);
+void ensureLoaded(AppState* s, int needs);
+int isLoaded(AppState* s, int what);
+void rebuildIndex(AppState* s);
+void applyTotals(AppState* s, const Transaction* t, int sign);
+uint64_t rowDigest(const Transaction* t);
+void saveFingerprints(AppState* s);
+void dropSnapshotIndex(AppState* s);
+void freeAppState(AppState* s);
+
+#endif
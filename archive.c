@@ -0,0 +1,421 @@
+#define _POSIX_C_SOURCE 200809L  // truncate
+#include "archive.h"
+#include "file_ops.h"
+#include "utils.h"
+#include <stdint.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t capacity;
+} ByteBuffer;
+
+static void putByte(ByteBuffer* b, unsigned char c) {
+    if (b->len == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 256;
+        b->data = (unsigned char*)realloc(b->data, b->capacity);
+    }
+    b->data[b->len++] = c;
+}
+
+static void putVarint(ByteBuffer* b, uint64_t v) {
+    while (v >= 0x80) {
+        putByte(b, (unsigned char)(v | 0x80));
+        v >>= 7;
+    }
+    putByte(b, (unsigned char)v);
+}
+
+static void putSigned(ByteBuffer* b, int64_t v) {
+    putVarint(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static int getVarint(const unsigned char** p, const unsigned char* end, uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char c = *(*p)++;
+        *v |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return 1;
+    }
+    return 0;
+}
+
+static int getSigned(const unsigned char** p, const unsigned char* end, int64_t* v) {
+    uint64_t u;
+    if (!getVarint(p, end, &u)) return 0;
+    *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+    return 1;
+}
+
+// Days since 1970-01-01 in the proleptic Gregorian calendar.
+static long dayNumber(Date d) {
+    int y = d.year - (d.month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (d.month + (d.month > 2 ? -3 : 9)) + 2) / 5 + d.day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static Date fromDayNumber(long z) {
+    z += 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    Date d;
+    d.day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    d.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    d.year = (int)(yoe + era * 400 + (d.month <= 2));
+    return d;
+}
+
+static int compareByDate(const void* a, const void* b) {
+    const Transaction* ta = (const Transaction*)a;
+    const Transaction* tb = (const Transaction*)b;
+    int ka = dateKey(ta->date), kb = dateKey(tb->date);
+    if (ka != kb) return (ka > kb) - (ka < kb);
+    return (ta->id > tb->id) - (ta->id < tb->id);
+}
+
+typedef struct {
+    const char** strings;
+    int count;
+    int* slots;
+    int slotCount;
+} Dictionary;
+
+static unsigned int stringHash(const char* s) {
+    unsigned int h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Index of s in the dictionary, adding it if new. Strings are borrowed.
+static int dictIndex(Dictionary* d, const char* s) {
+    if ((d->count + 1) * 2 > d->slotCount) {
+        int slotCount = d->slotCount ? d->slotCount * 2 : 64;
+        int* slots = (int*)calloc(slotCount, sizeof(int));
+        for (int i = 0; i < d->count; i++) {
+            unsigned int h = stringHash(d->strings[i]) & (slotCount - 1);
+            while (slots[h]) h = (h + 1) & (slotCount - 1);
+            slots[h] = i + 1;
+        }
+        free(d->slots);
+        d->slots = slots;
+        d->slotCount = slotCount;
+        d->strings = (const char**)realloc(d->strings, sizeof(char*) * (slotCount / 2));
+    }
+    unsigned int h = stringHash(s) & (d->slotCount - 1);
+    while (d->slots[h]) {
+        int i = d->slots[h] - 1;
+        if (strcmp(d->strings[i], s) == 0) return i;
+        h = (h + 1) & (d->slotCount - 1);
+    }
+    d->strings[d->count] = s;
+    d->slots[h] = ++d->count;
+    return d->count - 1;
+}
+
+// Sorts rows by date and appends them as one pending segment, synced to
+// disk, at *offset. Its rows must leave the data file before it is
+// committed with commitArchiveSegment().
+int appendArchiveSegment(const char* filename, Transaction* rows, int n, long* offset) {
+    *offset = -1;
+    if (n <= 0) return 1;
+    qsort(rows, n, sizeof(Transaction), compareByDate);
+
+    ArchiveHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ARCHIVE_PENDING_MAGIC, 4);
+    h.version = ARCHIVE_VERSION;
+    h.count = n;
+    h.minDate = dateKey(rows[0].date);
+    h.maxDate = dateKey(rows[n - 1].date);
+
+    Dictionary dict;
+    memset(&dict, 0, sizeof(dict));
+    ByteBuffer cols[ARCHIVE_COLUMNS];
+    memset(cols, 0, sizeof(cols));
+    long prevId = 0, prevDay = 0;
+    for (int i = 0; i < n; i++) {
+        const Transaction* t = &rows[i];
+        long day = dayNumber(t->date);
+        long long cents = (long long)(t->amount * 100 + (t->amount < 0 ? -0.5 : 0.5));
+        putSigned(&cols[ARCHIVE_COL_ID], t->id - prevId);
+        putSigned(&cols[ARCHIVE_COL_DATE], day - prevDay);
+        putSigned(&cols[ARCHIVE_COL_AMOUNT], cents);
+        putVarint(&cols[ARCHIVE_COL_TYPE], dictIndex(&dict, t->type));
+        putVarint(&cols[ARCHIVE_COL_CATEGORY], dictIndex(&dict, t->category));
+        putVarint(&cols[ARCHIVE_COL_DESCRIPTION], dictIndex(&dict, t->description));
+        prevId = t->id;
+        prevDay = day;
+
+        if (t->id > h.maxId) h.maxId = t->id;
+        if (strcmp(t->type, "Income") == 0) h.totalIncome += t->amount;
+        else if (strcmp(t->type, "Expense") == 0) h.totalExpense += t->amount;
+    }
+
+    ByteBuffer strings;
+    memset(&strings, 0, sizeof(strings));
+    for (int i = 0; i < dict.count; i++) {
+        size_t len = strlen(dict.strings[i]);
+        putVarint(&strings, len);
+        for (size_t k = 0; k < len; k++) putByte(&strings, (unsigned char)dict.strings[i][k]);
+    }
+    h.dictCount = dict.count;
+    h.dictBytes = (long)strings.len;
+    for (int c = 0; c < ARCHIVE_COLUMNS; c++) h.columnBytes[c] = (long)cols[c].len;
+
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "ab");
+    int ok = fp != NULL && fseek(fp, 0, SEEK_END) == 0 && (*offset = ftell(fp)) >= 0;
+    if (fp) {
+        ok = ok && fwrite(&h, sizeof(h), 1, fp) == 1 && fwrite(strings.data, 1, strings.len, fp) == strings.len;
+        for (int c = 0; c < ARCHIVE_COLUMNS && ok; c++) {
+            ok = fwrite(cols[c].data, 1, cols[c].len, fp) == cols[c].len;
+        }
+        if (fclose(fp) != 0) ok = 0;
+        ok = ok && syncFile(path);
+        if (!ok && *offset >= 0) discardArchiveSegment(filename, *offset);
+    }
+
+    for (int c = 0; c < ARCHIVE_COLUMNS; c++) free(cols[c].data);
+    free(strings.data);
+    free(dict.strings);
+    free(dict.slots);
+    return ok;
+}
+
+static long segmentBodySize(const ArchiveHeader* h) {
+    long size = h->dictBytes;
+    for (int c = 0; c < ARCHIVE_COLUMNS; c++) size += h->columnBytes[c];
+    return size;
+}
+
+static int validHeader(const ArchiveHeader* h) {
+    return h->version == ARCHIVE_VERSION && h->count >= 0 && segmentBodySize(h) >= 0;
+}
+
+// Reads the next committed segment header; stops at a pending one.
+static int readHeader(FILE* fp, ArchiveHeader* h) {
+    return fread(h, sizeof(*h), 1, fp) == 1 && memcmp(h->magic, ARCHIVE_MAGIC, 4) == 0 && validHeader(h);
+}
+
+int commitArchiveSegment(const char* filename, long offset) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "r+b");
+    if (!fp) return 0;
+    int ok = fseek(fp, offset, SEEK_SET) == 0 && fwrite(ARCHIVE_MAGIC, 1, 4, fp) == 4;
+    if (fclose(fp) != 0) ok = 0;
+    return ok;
+}
+
+int discardArchiveSegment(const char* filename, long offset) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+#ifdef _WIN32
+    int fd = _open(path, _O_RDWR | _O_BINARY);
+    if (fd < 0) return 0;
+    int ok = _chsize(fd, offset) == 0;
+    _close(fd);
+    return ok;
+#else
+    return truncate(path, offset) == 0;
+#endif
+}
+
+// Resolves what an archive that did not finish left after the last
+// committed segment. A complete pending segment is decided by the data
+// file: if it still holds the segment's newest id the rows never left it
+// and the segment is dropped; otherwise it is committed. Anything torn is
+// dropped, since segments are synced before the data file is rewritten.
+void settleArchive(const char* filename) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+
+    ArchiveHeader h;
+    long offset = 0;
+    int pending = 0;
+    while (fread(&h, sizeof(h), 1, fp) == 1 && validHeader(&h)) {
+        pending = memcmp(h.magic, ARCHIVE_PENDING_MAGIC, 4) == 0;
+        if (pending || memcmp(h.magic, ARCHIVE_MAGIC, 4) != 0) break;
+        offset += (long)sizeof(h) + segmentBodySize(&h);
+        if (fseek(fp, offset, SEEK_SET) != 0) break;
+    }
+    fclose(fp);
+
+    long size = fileSize(path);
+    if (size <= offset) return;
+    if (pending && size >= offset + (long)sizeof(h) + segmentBodySize(&h) && !streamHasId(filename, h.maxId)) {
+        commitArchiveSegment(filename, offset);
+    } else {
+        discardArchiveSegment(filename, offset);
+    }
+}
+
+// Header totals only; no segment is decoded.
+int readArchiveSummary(const char* filename, ArchiveSummary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    ArchiveHeader h;
+    while (readHeader(fp, &h)) {
+        summary->segments++;
+        summary->count += h.count;
+        summary->totalIncome += h.totalIncome;
+        summary->totalExpense += h.totalExpense;
+        if (h.maxDate > summary->maxDate) summary->maxDate = h.maxDate;
+        if (h.maxId > summary->maxId) summary->maxId = h.maxId;
+        if (fseek(fp, segmentBodySize(&h), SEEK_CUR) != 0) break;
+    }
+    fclose(fp);
+    return summary->segments > 0;
+}
+
+static int decodeSegment(const ArchiveHeader* h, const unsigned char* body, int fromDate, int toDate,
+                         TransactionVisitor visit, void* ctx, long* visited) {
+    const unsigned char* p = body;
+    const unsigned char* end = body + h->dictBytes;
+    const char** strings = (const char**)malloc(sizeof(char*) * (h->dictCount + 1));
+    size_t* lengths = (size_t*)malloc(sizeof(size_t) * (h->dictCount + 1));
+    int ok = 1;
+    for (int i = 0; i < h->dictCount && ok; i++) {
+        uint64_t len;
+        ok = getVarint(&p, end, &len) && len <= (uint64_t)(end - p);
+        if (ok) {
+            strings[i] = (const char*)p;
+            lengths[i] = (size_t)len;
+            p += len;
+        }
+    }
+
+    const unsigned char* col[ARCHIVE_COLUMNS];
+    const unsigned char* colEnd[ARCHIVE_COLUMNS];
+    const unsigned char* q = body + h->dictBytes;
+    for (int c = 0; c < ARCHIVE_COLUMNS; c++) {
+        col[c] = q;
+        q += h->columnBytes[c];
+        colEnd[c] = q;
+    }
+
+    int64_t id = 0, day = 0;
+    int keepGoing = 1;
+    for (int i = 0; i < h->count && ok && keepGoing; i++) {
+        int64_t dId, dDay, cents;
+        uint64_t type, category, description;
+        ok = getSigned(&col[ARCHIVE_COL_ID], colEnd[ARCHIVE_COL_ID], &dId) &&
+             getSigned(&col[ARCHIVE_COL_DATE], colEnd[ARCHIVE_COL_DATE], &dDay) &&
+             getSigned(&col[ARCHIVE_COL_AMOUNT], colEnd[ARCHIVE_COL_AMOUNT], &cents) &&
+             getVarint(&col[ARCHIVE_COL_TYPE], colEnd[ARCHIVE_COL_TYPE], &type) &&
+             getVarint(&col[ARCHIVE_COL_CATEGORY], colEnd[ARCHIVE_COL_CATEGORY], &category) &&
+             getVarint(&col[ARCHIVE_COL_DESCRIPTION], colEnd[ARCHIVE_COL_DESCRIPTION], &description) &&
+             type < (uint64_t)h->dictCount && category < (uint64_t)h->dictCount &&
+             description < (uint64_t)h->dictCount;
+        if (!ok) break;
+        id += dId;
+        day += dDay;
+
+        Transaction t;
+        t.id = (int)id;
+        t.date = fromDayNumber((long)day);
+        int key = dateKey(t.date);
+        if (key > toDate) break;
+        if (key < fromDate) continue;
+        t.amount = cents / 100.0;
+        snprintf(t.type, MAX_TYPE, "%.*s", (int)lengths[type], strings[type]);
+        snprintf(t.category, MAX_CAT, "%.*s", (int)lengths[category], strings[category]);
+        snprintf(t.description, MAX_DESC, "%.*s", (int)lengths[description], strings[description]);
+        (*visited)++;
+        keepGoing = visit(&t, ctx);
+    }
+    free(strings);
+    free(lengths);
+    return ok && keepGoing;
+}
+
+// Visits archived rows dated fromDate..toDate (yyyymmdd, inclusive), in
+// date order within each segment. Segments outside the range are skipped
+// by their headers. Returns the number of rows visited.
+long scanArchive(const char* filename, int fromDate, int toDate, TransactionVisitor visit, void* ctx) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    long visited = 0;
+    ArchiveHeader h;
+    while (readHeader(fp, &h)) {
+        long size = segmentBodySize(&h);
+        if (h.maxDate < fromDate || h.minDate > toDate) {
+            if (fseek(fp, size, SEEK_CUR) != 0) break;
+            continue;
+        }
+        unsigned char* body = (unsigned char*)malloc(size > 0 ? size : 1);
+        int ok = body && fread(body, 1, size, fp) == (size_t)size &&
+                 decodeSegment(&h, body, fromDate, toDate, visit, ctx, &visited);
+        free(body);
+        if (!ok) break;
+    }
+    fclose(fp);
+    return visited;
+}
+
+static int visitRangeTotals(const Transaction* t, void* ctx) {
+    ArchiveSummary* summary = (ArchiveSummary*)ctx;
+    summary->count++;
+    if (strcmp(t->type, "Income") == 0) summary->totalIncome += t->amount;
+    else if (strcmp(t->type, "Expense") == 0) summary->totalExpense += t->amount;
+    return 1;
+}
+
+// Totals of archived rows dated fromDate..toDate. Segments wholly inside
+// the range are answered from their headers; only partial ones are decoded.
+void archiveRangeTotals(const char* filename, int fromDate, int toDate, ArchiveSummary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "archive");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return;
+
+    ArchiveHeader h;
+    while (readHeader(fp, &h)) {
+        long size = segmentBodySize(&h);
+        if (h.maxDate < fromDate || h.minDate > toDate) {
+            if (fseek(fp, size, SEEK_CUR) != 0) break;
+            continue;
+        }
+        summary->segments++;
+        if (h.minDate >= fromDate && h.maxDate <= toDate) {
+            summary->count += h.count;
+            summary->totalIncome += h.totalIncome;
+            summary->totalExpense += h.totalExpense;
+            if (fseek(fp, size, SEEK_CUR) != 0) break;
+            continue;
+        }
+        unsigned char* body = (unsigned char*)malloc(size > 0 ? size : 1);
+        long visited = 0;
+        int ok = body && fread(body, 1, size, fp) == (size_t)size &&
+                 decodeSegment(&h, body, fromDate, toDate, visitRangeTotals, summary, &visited);
+        free(body);
+        if (!ok) break;
+    }
+    fclose(fp);
+}
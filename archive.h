@@ -0,0 +1,58 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "common.h"
+#include "stream.h"
+
+#define ARCHIVE_MAGIC "EXPA"
+#define ARCHIVE_PENDING_MAGIC "EXPP"
+#define ARCHIVE_VERSION 1
+
+#define ARCHIVE_COL_ID 0
+#define ARCHIVE_COL_DATE 1
+#define ARCHIVE_COL_AMOUNT 2
+#define ARCHIVE_COL_TYPE 3
+#define ARCHIVE_COL_CATEGORY 4
+#define ARCHIVE_COL_DESCRIPTION 5
+#define ARCHIVE_COLUMNS 6
+
+// Cold tier: <file>.archive is a sequence of segments, each holding rows
+// moved out of the data file in date order, stored column by column:
+// zigzag varint deltas for ids and day numbers, amounts as integer cents,
+// and type/category/description as indexes into a per-segment string
+// dictionary. Segment headers carry the date range and totals, so totals
+// and queries that stop short of the archived dates never decode it.
+// A segment is appended as pending and only committed once its rows have
+// left the data file; readers stop at a pending segment.
+typedef struct {
+    char magic[4];
+    int version;
+    int count;
+    int minDate;    // yyyymmdd
+    int maxDate;
+    int maxId;
+    double totalIncome;
+    double totalExpense;
+    int dictCount;
+    long dictBytes;
+    long columnBytes[ARCHIVE_COLUMNS];
+} ArchiveHeader;
+
+typedef struct {
+    int segments;
+    int count;
+    int maxDate;
+    int maxId;
+    double totalIncome;
+    double totalExpense;
+} ArchiveSummary;
+
+int appendArchiveSegment(const char* filename, Transaction* rows, int n, long* offset);
+int commitArchiveSegment(const char* filename, long offset);
+int discardArchiveSegment(const char* filename, long offset);
+void settleArchive(const char* filename);
+int readArchiveSummary(const char* filename, ArchiveSummary* summary);
+long scanArchive(const char* filename, int fromDate, int toDate, TransactionVisitor visit, void* ctx);
+void archiveRangeTotals(const char* filename, int fromDate, int toDate, ArchiveSummary* summary);
+
+#endif
@@ -1,7 +1,9 @@
 #include "bst.h"
+#include "metrics.h"
 
 BSTNode* createBSTNode(Transaction data) {
     BSTNode* newNode = (BSTNode*)malloc(sizeof(BSTNode));
+    metrics.nodesAllocated++;
     newNode->data = data;
     newNode->left = newNode->right = NULL;
     return newNode;
@@ -21,40 +23,57 @@ BSTNode* insertBST(BSTNode* root, Transaction data) {
     return root;
 }
 
-void searchBST(BSTNode* root, double amount) {
+// Builds a height-balanced tree from rows[order[lo..hi]], which must be
+// sorted by amount. The root of each subtree is the first row of its run
+// of equal amounts so that equal keys only ever sit in right subtrees,
+// matching what insertBST and searchBST expect.
+BSTNode* buildBalancedBST(const Transaction* rows, const int* order, int lo, int hi) {
+    if (lo > hi) return NULL;
+
+    int mid = lo + (hi - lo) / 2;
+    double key = rows[order[mid]].amount;
+    int first = lo, last = mid;
+    while (first < last) {
+        int m = first + (last - first) / 2;
+        if (rows[order[m]].amount < key) first = m + 1;
+        else last = m;
+    }
+    mid = first;
+
+    BSTNode* node = createBSTNode(rows[order[mid]]);
+    node->left = buildBalancedBST(rows, order, lo, mid - 1);
+    node->right = buildBalancedBST(rows, order, mid + 1, hi);
+    return node;
+}
+
+int searchBST(BSTNode* root, double amount, OutputWriter* w) {
     if (root == NULL) {
-        return;
+        return 1;
     }
 
     if (root->data.amount == amount) {
-        printf("%-5d %02d/%02d/%04d   %-10.2f %-10s %-15s %-20s\n", 
-               root->data.id, 
-               root->data.date.day, root->data.date.month, root->data.date.year, 
-               root->data.amount, 
-               root->data.type, 
-               root->data.category, 
-               root->data.description);
+        if (!outTransaction(w, &root->data)) return 0;
     }
 
     if (amount < root->data.amount) {
-        searchBST(root->left, amount);
+        return searchBST(root->left, amount, w);
     } else {
-        searchBST(root->right, amount); 
+        return searchBST(root->right, amount, w);
     }
 }
 
-void inorderTraversal(BSTNode* root) {
-    if (root != NULL) {
-        inorderTraversal(root->left);
-        printf("%-5d %02d/%02d/%04d   %-10.2f %-10s %-15s %-20s\n", 
-               root->data.id, 
-               root->data.date.day, root->data.date.month, root->data.date.year, 
-               root->data.amount, 
-               root->data.type, 
-               root->data.category, 
-               root->data.description);
-        inorderTraversal(root->right);
-    }
+int inorderTraversal(BSTNode* root, OutputWriter* w) {
+    if (root == NULL) return 1;
+    if (!inorderTraversal(root->left, w)) return 0;
+    if (!outTransaction(w, &root->data)) return 0;
+    return inorderTraversal(root->right, w);
+}
+
+int treeDepth(BSTNode* root) {
+    if (root == NULL) return 0;
+    int left = treeDepth(root->left);
+    int right = treeDepth(root->right);
+    return 1 + (left > right ? left : right);
 }
 
 void freeBST(BSTNode* root) {
@@ -2,6 +2,7 @@
 #define BST_H
 
 #include "common.h"
+#include "output.h"
 
 typedef struct BSTNode {
     Transaction data;
@@ -9,8 +10,10 @@ typedef struct BSTNode {
 } BSTNode;
 
 BSTNode* insertBST(BSTNode* root, Transaction data);
-void searchBST(BSTNode* root, double amount);
-void inorderTraversal(BSTNode* root);
+BSTNode* buildBalancedBST(const Transaction* rows, const int* order, int lo, int hi);
+int searchBST(BSTNode* root, double amount, OutputWriter* w);
+int inorderTraversal(BSTNode* root, OutputWriter* w);
+int treeDepth(BSTNode* root);
 void freeBST(BSTNode* root);
 
 #endif
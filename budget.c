@@ -0,0 +1,252 @@
+#include "budget.h"
+#include "file_ops.h"
+#include "writebehind.h"
+
+static unsigned int budgetHash(const char* category, int period) {
+    unsigned int h = 2166136261u;
+    for (const char* p = category; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    h ^= (unsigned int)period;
+    h *= 16777619u;
+    return h;
+}
+
+static void rehash(BudgetBook* b, int slotCount) {
+    free(b->slots);
+    b->slots = (int*)calloc(slotCount, sizeof(int));
+    b->slotCount = slotCount;
+    for (int i = 0; i < b->count; i++) {
+        unsigned int h = budgetHash(b->entries[i].category, b->entries[i].period) & (slotCount - 1);
+        while (b->slots[h]) h = (h + 1) & (slotCount - 1);
+        b->slots[h] = i + 1;
+    }
+}
+
+static BudgetEntry* findEntry(BudgetBook* b, const char* category, int period) {
+    if (b->slotCount == 0) return NULL;
+    unsigned int h = budgetHash(category, period) & (b->slotCount - 1);
+    while (b->slots[h]) {
+        BudgetEntry* e = &b->entries[b->slots[h] - 1];
+        if (e->period == period && strcmp(e->category, category) == 0) return e;
+        h = (h + 1) & (b->slotCount - 1);
+    }
+    return NULL;
+}
+
+static BudgetEntry* addEntry(BudgetBook* b, const char* category, int period) {
+    if (b->count == b->capacity) {
+        int capacity = b->capacity ? b->capacity * 2 : 16;
+        BudgetEntry* grown = (BudgetEntry*)realloc(b->entries, sizeof(BudgetEntry) * capacity);
+        if (!grown) return NULL;
+        b->entries = grown;
+        b->capacity = capacity;
+    }
+    BudgetEntry* e = &b->entries[b->count++];
+    memset(e, 0, sizeof(BudgetEntry));
+    strncpy(e->category, category, MAX_CAT - 1);
+    e->period = period;
+
+    if (b->count * 2 > b->slotCount) {
+        rehash(b, b->slotCount ? b->slotCount * 2 : 32);
+    } else {
+        unsigned int h = budgetHash(e->category, period) & (b->slotCount - 1);
+        while (b->slots[h]) h = (h + 1) & (b->slotCount - 1);
+        b->slots[h] = b->count;
+    }
+    return e;
+}
+
+static int isExpense(const Transaction* t) {
+    return strcmp(t->type, "Expense") == 0;
+}
+
+static void raiseAlert(AppState* s, const BudgetEntry* e, double limit) {
+    statusPrintf("Budget alert: %s spending for %02d/%04d is %.2f, over the %.2f limit.\n",
+           e->category, e->period % 100, e->period / 100, e->spent, limit);
+
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "alerts");
+    FILE* fp = fopen(path, "a");
+    if (!fp) return;
+    fprintf(fp, "%d %.2f %.2f %s\n", e->period, e->spent, limit, e->category);
+    fclose(fp);
+}
+
+// Adds 'amount' to the running month counter for t's category, creating it
+// only when a rule could apply. Returns the counter, or NULL if untracked.
+static BudgetEntry* bumpCounter(BudgetBook* b, const Transaction* t, double amount, double* before) {
+    int period = t->date.year * 100 + t->date.month;
+    BudgetEntry* e = findEntry(b, t->category, period);
+    if (!e) {
+        BudgetEntry* g = findEntry(b, t->category, 0);
+        if (!g || !g->hasRule) return NULL;
+        e = addEntry(b, t->category, period);
+        if (!e) return NULL;
+    }
+    *before = e->spent;
+    e->spent += amount;
+    return e;
+}
+
+static double limitFor(BudgetBook* b, const BudgetEntry* e) {
+    if (e->hasRule) return e->limit;
+    BudgetEntry* g = findEntry(b, e->category, 0);
+    return (g && g->hasRule) ? g->limit : -1;
+}
+
+static void recomputeCategory(AppState* s, const char* category) {
+    BudgetBook* b = s->budgets;
+    for (int i = 0; i < b->count; i++) {
+        if (category == NULL || strcmp(b->entries[i].category, category) == 0) {
+            b->entries[i].spent = 0;
+        }
+    }
+    double before;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+        if (!isExpense(&temp->data)) continue;
+        if (category && strcmp(temp->data.category, category) != 0) continue;
+        bumpCounter(b, &temp->data, temp->data.amount, &before);
+    }
+}
+
+// Counters are trusted only if they were saved at the current generation
+// against a data file of the current size; otherwise they are rebuilt.
+void loadBudgets(AppState* s) {
+    BudgetBook* b = (BudgetBook*)calloc(1, sizeof(BudgetBook));
+    s->budgets = b;
+
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "budgets");
+    FILE* fp = fopen(path, "r");
+    if (!fp) return;
+
+    long generation = -1, dataSize = -1;
+    if (fscanf(fp, "G %ld %ld\n", &generation, &dataSize) != 2) {
+        fclose(fp);
+        return;
+    }
+
+    BudgetEntry in;
+    while (fscanf(fp, "E %d %d %lf %lf %49s\n", &in.period, &in.hasRule, &in.limit, &in.spent, in.category) == 5) {
+        BudgetEntry* e = addEntry(b, in.category, in.period);
+        if (!e) break;
+        e->hasRule = in.hasRule;
+        e->limit = in.limit;
+        e->spent = in.spent;
+    }
+    fclose(fp);
+
+    if (generation != s->generation || dataSize != fileSize(s->filename)) {
+        recomputeCategory(s, NULL);
+    }
+}
+
+void saveBudgets(AppState* s) {
+    BudgetBook* b = s->budgets;
+    if (!b || b->count == 0) return;
+
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), s->filename, "budgets");
+    FILE* fp = openForReplace(path, "w", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+
+    fprintf(fp, "G %ld %ld\n", s->generation, fileSize(s->filename));
+    for (int i = 0; i < b->count; i++) {
+        BudgetEntry* e = &b->entries[i];
+        fprintf(fp, "E %d %d %.2f %.2f %s\n", e->period, e->hasRule, e->limit, e->spent, e->category);
+    }
+    commitReplaceSynced(fp, tmpPath, path);
+}
+
+void freeBudgets(AppState* s) {
+    if (!s->budgets) return;
+    free(s->budgets->entries);
+    free(s->budgets->slots);
+    free(s->budgets);
+    s->budgets = NULL;
+}
+
+void budgetOnAdd(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_BUDGETS) || !isExpense(t)) return;
+    double before;
+    BudgetEntry* e = bumpCounter(s->budgets, t, t->amount, &before);
+    if (e) {
+        double limit = limitFor(s->budgets, e);
+        if (limit >= 0 && before <= limit && e->spent > limit) raiseAlert(s, e, limit);
+    }
+    if (!deferSave(s, DIRTY_BUDGETS)) saveBudgets(s);
+}
+
+void budgetOnDelete(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_BUDGETS) || !isExpense(t)) return;
+    double before;
+    bumpCounter(s->budgets, t, -t->amount, &before);
+    if (!deferSave(s, DIRTY_BUDGETS)) saveBudgets(s);
+}
+
+void setBudget(AppState* s, const char* category, double limit, int month, int year) {
+    int period = month > 0 ? year * 100 + month : 0;
+    BudgetEntry* e = findEntry(s->budgets, category, period);
+    if (!e) e = addEntry(s->budgets, category, period);
+    if (!e) return;
+    e->hasRule = 1;
+    e->limit = limit;
+
+    // A new rule may cover months that were not being counted yet.
+    recomputeCategory(s, category);
+    saveBudgets(s);
+}
+
+int removeBudget(AppState* s, const char* category, int month, int year) {
+    int period = month > 0 ? year * 100 + month : 0;
+    BudgetEntry* e = findEntry(s->budgets, category, period);
+    if (!e || !e->hasRule) return 0;
+    e->hasRule = 0;
+    saveBudgets(s);
+    return 1;
+}
+
+void displayBudgets(AppState* s) {
+    BudgetBook* b = s->budgets;
+    time_t now = time(NULL);
+    struct tm* tm = localtime(&now);
+    int current = (tm->tm_year + 1900) * 100 + tm->tm_mon + 1;
+
+    int shown = 0;
+    for (int i = 0; i < b->count; i++) {
+        BudgetEntry* e = &b->entries[i];
+        if (!e->hasRule) continue;
+        if (shown++ == 0) {
+            printf("\n%-15s %-10s %-10s %-10s\n", "Category", "Period", "Limit", "Spent");
+            printf("-----------------------------------------------\n");
+        }
+        int period = e->period ? e->period : current;
+        BudgetEntry* counter = findEntry(b, e->category, period);
+        char label[16];
+        if (e->period) sprintf(label, "%02d/%04d", e->period % 100, e->period / 100);
+        else strcpy(label, "monthly");
+        printf("%-15s %-10s %-10.2f %-10.2f\n", e->category, label, e->limit, counter ? counter->spent : 0.0);
+    }
+    if (shown == 0) printf("No budgets set.\n");
+    else printf("-----------------------------------------------\n");
+}
+
+void displayAlerts(const char* filename) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "alerts");
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        printf("No budget alerts.\n");
+        return;
+    }
+
+    int period;
+    double spent, limit;
+    char category[MAX_CAT];
+    while (fscanf(fp, "%d %lf %lf %49s", &period, &spent, &limit, category) == 4) {
+        printf("%02d/%04d %-15s spent %.2f of %.2f\n", period % 100, period / 100, category, spent, limit);
+    }
+    fclose(fp);
+}
@@ -0,0 +1,36 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include "common.h"
+#include "appstate.h"
+
+// One entry per (category, period). period is year*100+month, or 0 for a
+// rule that applies to every month. Month entries carry the running
+// expense total for that month and optionally a month-specific limit.
+typedef struct {
+    char category[MAX_CAT];
+    int period;
+    int hasRule;
+    double limit;
+    double spent;
+} BudgetEntry;
+
+struct BudgetBook {
+    BudgetEntry* entries;
+    int count;
+    int capacity;
+    int* slots;
+    int slotCount;
+};
+
+void loadBudgets(AppState* s);
+void saveBudgets(AppState* s);
+void freeBudgets(AppState* s);
+void budgetOnAdd(AppState* s, const Transaction* t);
+void budgetOnDelete(AppState* s, const Transaction* t);
+void setBudget(AppState* s, const char* category, double limit, int month, int year);
+int removeBudget(AppState* s, const char* category, int month, int year);
+void displayBudgets(AppState* s);
+void displayAlerts(const char* filename);
+
+#endif
@@ -0,0 +1,384 @@
+#define _POSIX_C_SOURCE 200809L  // strdup
+#include "cache.h"
+#include "file_ops.h"
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+#define CACHE_MAGIC "EXPC"
+
+typedef struct {
+    char* key;
+    char* data;
+    size_t len;
+} CacheEntry;
+
+typedef struct {
+    char filename[256];
+    long generation;
+    int count;
+    CacheEntry entries[CACHE_MAX_ENTRIES];
+} CacheTable;
+
+#define CAPTURE_MAX_EXCLUDED 4
+
+typedef struct {
+    FILE* sink;
+    FILE* tmp;
+    int savedFd;
+    int active;
+    long excluded[CAPTURE_MAX_EXCLUDED][2];
+    int excludedCount;
+} ResultCapture;
+
+static CacheTable resident;
+static ResultCapture capture;
+
+long dataGeneration(const char* filename) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "gen");
+    FILE* fp = fopen(path, "r");
+    long gen = 0;
+    if (fp) {
+        if (fscanf(fp, "%ld", &gen) != 1) gen = 0;
+        fclose(fp);
+    }
+    return gen;
+}
+
+long bumpDataGeneration(const char* filename) {
+    char path[256], tmpPath[256];
+    long gen = dataGeneration(filename) + 1;
+    sidecarPath(path, sizeof(path), filename, "gen");
+    FILE* fp = openForReplace(path, "w", tmpPath, sizeof(tmpPath));
+    if (fp) {
+        fprintf(fp, "%ld\n", gen);
+        commitReplace(fp, tmpPath, path);
+    }
+    return gen;
+}
+
+// FNV-1a over a file's bytes, for inputs that have no generation of their
+// own (0 if the file is missing).
+unsigned long long contentDigest(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+    unsigned long long h = 14695981039346656037ULL;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            h ^= (unsigned char)buf[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(fp);
+    return h;
+}
+
+static void clearTable(CacheTable* t) {
+    for (int i = 0; i < t->count; i++) {
+        free(t->entries[i].key);
+        free(t->entries[i].data);
+    }
+    t->count = 0;
+}
+
+// Newest entries are kept at the end; the oldest is evicted when full.
+static void tablePut(CacheTable* t, const char* key, const char* data, size_t len) {
+    for (int i = 0; i < t->count; i++) {
+        if (strcmp(t->entries[i].key, key) == 0) {
+            free(t->entries[i].key);
+            free(t->entries[i].data);
+            memmove(&t->entries[i], &t->entries[i + 1], sizeof(CacheEntry) * (t->count - i - 1));
+            t->count--;
+            break;
+        }
+    }
+    if (t->count == CACHE_MAX_ENTRIES) {
+        free(t->entries[0].key);
+        free(t->entries[0].data);
+        memmove(&t->entries[0], &t->entries[1], sizeof(CacheEntry) * (CACHE_MAX_ENTRIES - 1));
+        t->count--;
+    }
+    CacheEntry* e = &t->entries[t->count++];
+    e->key = strdup(key);
+    e->data = (char*)malloc(len > 0 ? len : 1);
+    memcpy(e->data, data, len);
+    e->len = len;
+}
+
+static const CacheEntry* tableGet(const CacheTable* t, const char* key) {
+    for (int i = 0; i < t->count; i++) {
+        if (strcmp(t->entries[i].key, key) == 0) return &t->entries[i];
+    }
+    return NULL;
+}
+
+// Format: "EXPC <generation>\n" then per entry "<keylen> <len>\n<key><data>".
+// Entries are appended; a later entry for the same key replaces an earlier
+// one.
+static FILE* openTable(const char* filename, long generation) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "cache");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    char magic[8];
+    long gen;
+    if (fscanf(fp, "%4s %ld", magic, &gen) != 2 || strcmp(magic, CACHE_MAGIC) != 0 || gen != generation ||
+        fgetc(fp) != '\n') {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+static int readEntryHeader(FILE* fp, size_t* keyLen, size_t* len) {
+    return fscanf(fp, "%zu %zu", keyLen, len) == 2 && fgetc(fp) == '\n' &&
+           *keyLen <= 4096 && *len <= CACHE_MAX_RESULT_BYTES;
+}
+
+static int readTable(const char* filename, long generation, CacheTable* t) {
+    FILE* fp = openTable(filename, generation);
+    if (!fp) return 0;
+
+    size_t keyLen, len;
+    while (readEntryHeader(fp, &keyLen, &len)) {
+        char* key = (char*)malloc(keyLen + 1);
+        char* data = (char*)malloc(len > 0 ? len : 1);
+        int ok = fread(key, 1, keyLen, fp) == keyLen && fread(data, 1, len, fp) == len;
+        if (ok) {
+            key[keyLen] = '\0';
+            tablePut(t, key, data, len);
+        }
+        free(key);
+        free(data);
+        if (!ok) break;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// Looks up one key without loading the other entries: only the key of each
+// entry is read. Also counts the entries. Returns 0 if there is no table
+// for this generation.
+static int findEntry(const char* filename, long generation, const char* key, char** data, size_t* len, int* count) {
+    FILE* fp = openTable(filename, generation);
+    if (!fp) return 0;
+
+    char entryKey[4097];
+    size_t keyLen, entryLen;
+    long found = -1;
+    *count = 0;
+    while (readEntryHeader(fp, &keyLen, &entryLen) && fread(entryKey, 1, keyLen, fp) == keyLen) {
+        entryKey[keyLen] = '\0';
+        if (data && strcmp(entryKey, key) == 0) {
+            found = ftell(fp);
+            *len = entryLen;
+        }
+        if (fseek(fp, (long)entryLen, SEEK_CUR) != 0) break;
+        (*count)++;
+    }
+    if (data) *data = NULL;
+    if (data && found >= 0) {
+        *data = (char*)malloc(*len > 0 ? *len : 1);
+        if (fseek(fp, found, SEEK_SET) != 0 || fread(*data, 1, *len, fp) != *len) {
+            free(*data);
+            *data = NULL;
+        }
+    }
+    fclose(fp);
+    return 1;
+}
+
+static void writeEntry(FILE* fp, const char* key, const char* data, size_t len) {
+    fprintf(fp, "%zu %zu\n", strlen(key), len);
+    fputs(key, fp);
+    fwrite(data, 1, len, fp);
+}
+
+static void writeTable(const char* filename, const CacheTable* t) {
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), filename, "cache");
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+    fprintf(fp, "%s %ld\n", CACHE_MAGIC, t->generation);
+    for (int i = 0; i < t->count; i++) writeEntry(fp, t->entries[i].key, t->entries[i].data, t->entries[i].len);
+    commitReplace(fp, tmpPath, path);
+}
+
+// Readers store under a shared lock, so an entry goes out in a single
+// write on an append-mode stream and concurrent stores do not interleave.
+static int appendEntry(const char* filename, const char* key, const char* data, size_t len) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "cache");
+    char header[64];
+    int headerLen = snprintf(header, sizeof(header), "%zu %zu\n", strlen(key), len);
+    size_t keyLen = strlen(key);
+    size_t total = (size_t)headerLen + keyLen + len;
+    char* entry = (char*)malloc(total);
+    if (!entry) return 0;
+    memcpy(entry, header, headerLen);
+    memcpy(entry + headerLen, key, keyLen);
+    memcpy(entry + headerLen + keyLen, data, len);
+
+    FILE* fp = fopen(path, "ab");
+    int ok = fp != NULL;
+    if (fp) {
+        setvbuf(fp, NULL, _IONBF, 0);
+        ok = fwrite(entry, 1, total, fp) == total;
+        ok = fclose(fp) == 0 && ok;
+    }
+    free(entry);
+    return ok;
+}
+
+static void syncResident(const char* filename, long generation) {
+    if (strcmp(resident.filename, filename) != 0 || resident.generation != generation) {
+        clearTable(&resident);
+        snprintf(resident.filename, sizeof(resident.filename), "%s", filename);
+        resident.generation = generation;
+    }
+}
+
+int cacheLookup(const char* filename, const char* key, long generation, FILE* sink) {
+    syncResident(filename, generation);
+    const CacheEntry* e = tableGet(&resident, key);
+    if (!e) {
+        char* data;
+        size_t len;
+        int count;
+        if (findEntry(filename, generation, key, &data, &len, &count) && data) {
+            tablePut(&resident, key, data, len);
+            free(data);
+        }
+        e = tableGet(&resident, key);
+    }
+    if (!e) return 0;
+    fwrite(e->data, 1, e->len, sink);
+    fflush(sink);
+    return 1;
+}
+
+// New entries are appended; the file is only rewritten when it is stale or
+// has reached CACHE_MAX_ENTRIES, keeping the newest entries.
+void cacheStore(const char* filename, const char* key, long generation, const char* data, size_t len) {
+    if (len > CACHE_MAX_RESULT_BYTES) return;
+    syncResident(filename, generation);
+    tablePut(&resident, key, data, len);
+
+    int count;
+    if (findEntry(filename, generation, key, NULL, NULL, &count) && count < CACHE_MAX_ENTRIES &&
+        appendEntry(filename, key, data, len)) {
+        return;
+    }
+
+    CacheTable disk;
+    disk.count = 0;
+    disk.generation = generation;
+    readTable(filename, generation, &disk);
+    tablePut(&disk, key, data, len);
+    writeTable(filename, &disk);
+    clearTable(&disk);
+}
+
+// Puts the captured descriptor back on the sink and writes out everything
+// captured so far, in chunks.
+static void replayCapture(ResultCapture* c) {
+    fflush(stdout);
+    fflush(c->sink);
+    dup2(c->savedFd, fileno(c->sink));
+    close(c->savedFd);
+    c->active = 0;
+
+    rewind(c->tmp);
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), c->tmp)) > 0) fwrite(buf, 1, n, c->sink);
+    fflush(c->sink);
+}
+
+static long capturedBytes(ResultCapture* c) {
+    return (long)lseek(fileno(c->sink), 0, SEEK_CUR);
+}
+
+// Output past CACHE_MAX_RESULT_BYTES would never be stored, so capturing
+// stops there: what was captured is written out and the rest goes straight
+// to the sink.
+void checkCapture(void) {
+    ResultCapture* c = &capture;
+    if (!c->active) return;
+    fflush(stdout);
+    fflush(c->sink);
+    if (capturedBytes(c) <= CACHE_MAX_RESULT_BYTES) return;
+    replayCapture(c);
+    fclose(c->tmp);
+}
+
+// A cache hit loads nothing, so the load message is kept out of the
+// captured result (it is still shown on this run).
+void printLoadMessage(const char* filename) {
+    ResultCapture* c = &capture;
+    int exclude = c->active && fileno(stdout) == fileno(c->sink) && c->excludedCount < CAPTURE_MAX_EXCLUDED;
+    if (exclude) {
+        fflush(stdout);
+        c->excluded[c->excludedCount][0] = capturedBytes(c);
+    }
+    statusPrintf("Data loaded successfully from %s\n", filename);
+    if (exclude) {
+        fflush(stdout);
+        c->excluded[c->excludedCount++][1] = capturedBytes(c);
+    }
+}
+
+char* endCapture(size_t* len) {
+    ResultCapture* c = &capture;
+    *len = 0;
+    if (!c->active) return NULL;
+    replayCapture(c);
+
+    long size = ftell(c->tmp);
+    char* data = size <= CACHE_MAX_RESULT_BYTES ? (char*)malloc(size > 0 ? size : 1) : NULL;
+    long pos = 0;
+    for (int i = 0; data && i <= c->excludedCount; i++) {
+        long end = i < c->excludedCount ? c->excluded[i][0] : size;
+        if (end > pos) {
+            fseek(c->tmp, pos, SEEK_SET);
+            *len += fread(data + *len, 1, end - pos, c->tmp);
+        }
+        if (i < c->excludedCount) pos = c->excluded[i][1];
+    }
+    fclose(c->tmp);
+    return data;
+}
+
+// Early returns from main() still need their output shown.
+static void abandonCapture(void) {
+    size_t len;
+    free(endCapture(&len));
+}
+
+int beginCapture(FILE* sink) {
+    static int registered = 0;
+    ResultCapture* c = &capture;
+    c->sink = sink;
+    c->excludedCount = 0;
+    c->tmp = tmpfile();
+    if (!c->tmp) return 0;
+
+    fflush(sink);
+    c->savedFd = dup(fileno(sink));
+    if (c->savedFd < 0 || dup2(fileno(c->tmp), fileno(sink)) < 0) {
+        if (c->savedFd >= 0) close(c->savedFd);
+        fclose(c->tmp);
+        return 0;
+    }
+    if (!registered) {
+        atexit(abandonCapture);
+        registered = 1;
+    }
+    c->active = 1;
+    return 1;
+}
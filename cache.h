@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "common.h"
+
+#define CACHE_MAX_ENTRIES 32
+#define CACHE_MAX_RESULT_BYTES (1024 * 1024)
+
+// Result cache for read-only commands. <file>.gen holds a data generation
+// that every mutating command bumps under the write lock; <file>.cache
+// holds the output of recent reads, keyed on command line, and is only
+// valid for the generation recorded in its header. Hits are also kept in
+// process so a resident caller does not re-read the file. Writers bump the
+// generation only once something has actually changed.
+long dataGeneration(const char* filename);
+long bumpDataGeneration(const char* filename);
+unsigned long long contentDigest(const char* path);
+int cacheLookup(const char* filename, const char* key, long generation, FILE* sink);
+void cacheStore(const char* filename, const char* key, long generation, const char* data, size_t len);
+
+// Redirects everything written to 'sink' into a temporary file so a miss
+// can be stored. endCapture() restores the sink, replays the output and
+// returns a copy of it, or NULL if it grew past CACHE_MAX_RESULT_BYTES.
+// checkCapture() is called as output is flushed and gives up early on a
+// result that is already too large to keep.
+int beginCapture(FILE* sink);
+char* endCapture(size_t* len);
+void checkCapture(void);
+void printLoadMessage(const char* filename);
+
+#endif
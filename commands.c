@@ -0,0 +1,372 @@
+#include "commands.h"
+#include "file_ops.h"
+#include "snapshot.h"
+#include "viewstore.h"
+#include "budget.h"
+#include "versions.h"
+#include "sketch.h"
+#include "writebehind.h"
+#include "archive.h"
+#include "utils.h"
+#include <limits.h>
+
+// Ids stay unique across the archive, so archived rows can be told apart
+// from ones added after them.
+int getNextId(AppState* s) {
+    ArchiveSummary archived;
+    readArchiveSummary(s->filename, &archived);
+    int maxId = archived.maxId;
+    Node* temp = s->head;
+    while (temp != NULL) {
+        if (temp->data.id > maxId) {
+            maxId = temp->data.id;
+        }
+        temp = temp->next;
+    }
+    return maxId + 1;
+}
+
+// Derived state for a row already added to (sign 1) or removed from (-1)
+// s->head: totals, views, budgets, sketches, and the fingerprints when a
+// --dedupe run has loaded them.
+static void applyDerived(AppState* s, const Transaction* t, int sign) {
+    applyTotals(s, t, sign);
+    if (sign > 0) {
+        viewsOnAdd(s, t);
+        budgetOnAdd(s, t);
+        sketchOnAdd(s, t);
+        if (isLoaded(s, NEED_FINGERPRINTS)) fingerprintAdd(&s->fingerprints, t);
+    } else {
+        viewsOnDelete(s, t);
+        budgetOnDelete(s, t);
+        sketchOnDelete(s, t);
+        if (isLoaded(s, NEED_FINGERPRINTS)) fingerprintRemove(&s->fingerprints, t);
+    }
+    if (isLoaded(s, NEED_FINGERPRINTS) && !deferSave(s, DIRTY_FINGERPRINTS)) saveFingerprints(s);
+}
+
+// Saves the data file now unless write-behind owns the save.
+static void saveData(AppState* s) {
+    if (!deferSave(s, DIRTY_DATA) && !saveToFile(s->head, s->filename)) s->saveFailed = 1;
+}
+
+// Bookkeeping for one changed row, after the data file has been saved.
+static void recordChange(AppState* s, const Transaction* t, int sign) {
+    journalChange(s, sign > 0 ? JOURNAL_ADD : JOURNAL_DELETE, t);
+    applyDerived(s, t, sign);
+}
+
+void cmdAdd(AppState* s, Transaction t) {
+    addNode(&s->head, t);
+    push(&s->undoStack, t, OP_ADD);
+    if (!deferSave(s, DIRTY_UNDO)) saveStack(s->undoStack, "undo_stack.txt");
+    saveData(s);
+    recordChange(s, &t, 1);
+    versionsOnChange(s, VERSION_ADD, &t);
+    if (isLoaded(s, NEED_INDEX)) s->bstRoot = insertBST(s->bstRoot, t);
+    statusPrintf("Transaction added successfully. ID: %d\n", t.id);
+}
+
+void cmdDelete(AppState* s, int id) {
+    Node* nodeToDelete = findNode(s->head, id);
+    if (nodeToDelete) {
+        Transaction t = nodeToDelete->data;
+        if (deleteNode(&s->head, id)) {
+            push(&s->undoStack, t, OP_DELETE);
+            if (!deferSave(s, DIRTY_UNDO)) saveStack(s->undoStack, "undo_stack.txt");
+            saveData(s);
+            recordChange(s, &t, -1);
+            versionsOnChange(s, VERSION_DELETE, &t);
+            if (isLoaded(s, NEED_INDEX)) rebuildIndex(s);
+            statusPrintf("Transaction %d deleted successfully.\n", id);
+        }
+    } else {
+        statusPrintf("Error: Transaction %d not found.\n", id);
+    }
+}
+
+void cmdUndo(AppState* s) {
+    if (isStackEmpty(s->undoStack)) {
+        statusPrintf("Nothing to undo.\n");
+    } else {
+        OperationType opType;
+        Transaction t = pop(&s->undoStack, &opType);
+        
+        int sign = 0;
+        if (opType == OP_ADD) {
+            if (deleteNode(&s->head, t.id)) sign = -1;
+            statusPrintf("Undo: Removed transaction %d.\n", t.id);
+        } else if (opType == OP_DELETE) {
+            addNode(&s->head, t);
+            sign = 1;
+            statusPrintf("Undo: Restored transaction %d.\n", t.id);
+        }
+        saveData(s);
+        if (sign) {
+            recordChange(s, &t, sign);
+            versionsOnChange(s, sign > 0 ? VERSION_ADD : VERSION_DELETE, &t);
+        }
+        if (!deferSave(s, DIRTY_UNDO)) saveStack(s->undoStack, "undo_stack.txt");
+        if (isLoaded(s, NEED_INDEX)) rebuildIndex(s);
+    }
+}
+
+static int compareIds(const void* a, const void* b) {
+    const Transaction* ta = *(const Transaction* const*)a;
+    const Transaction* tb = *(const Transaction* const*)b;
+    return (ta->id > tb->id) - (ta->id < tb->id);
+}
+
+static int compareRowIds(const void* a, const void* b) {
+    const Transaction* ta = (const Transaction*)a;
+    const Transaction* tb = (const Transaction*)b;
+    return (ta->id > tb->id) - (ta->id < tb->id);
+}
+
+// Removes and adds many rows with one pass over the list, one rebuild of
+// the views and index, one save of each file and, if 'record' is set, one
+// version. removed must be sorted by id.
+static void applyBulk(AppState* s, Transaction* removed, int nRemoved, Transaction* added, int nAdded, int record) {
+    Node** link = &s->head;
+    while (nRemoved > 0 && *link != NULL) {
+        if (bsearch(&(*link)->data, removed, nRemoved, sizeof(Transaction), compareRowIds)) {
+            Node* gone = *link;
+            *link = gone->next;
+            free(gone);
+        } else {
+            link = &(*link)->next;
+        }
+    }
+    Node* tail = s->head;
+    while (tail != NULL && tail->next != NULL) tail = tail->next;
+    for (int k = 0; k < nAdded; k++) {
+        Node* node = createNode(added[k]);
+        if (!node) break;
+        if (tail) tail->next = node;
+        else s->head = node;
+        tail = node;
+    }
+
+    saveData(s);
+    journalChanges(s, JOURNAL_DELETE, removed, nRemoved);
+    journalChanges(s, JOURNAL_ADD, added, nAdded);
+
+    // Views are rebuilt once rather than edited row by row.
+    int wasDeferred = beginBatch(s);
+    int views = isLoaded(s, NEED_VIEWS);
+    s->loaded &= ~NEED_VIEWS;
+    for (int k = 0; k < nRemoved; k++) applyDerived(s, &removed[k], -1);
+    for (int k = 0; k < nAdded; k++) applyDerived(s, &added[k], 1);
+    if (views) {
+        s->loaded |= NEED_VIEWS;
+        rebuildViews(s);
+        deferSave(s, DIRTY_VIEWS);
+    }
+    endBatch(s, wasDeferred);
+    if (record) versionsOnBulk(s, removed, nRemoved, added, nAdded);
+    if (isLoaded(s, NEED_INDEX)) rebuildIndex(s);
+}
+
+static int sameRow(const Transaction* a, const Transaction* b) {
+    return a->id == b->id && a->amount == b->amount &&
+           a->date.day == b->date.day && a->date.month == b->date.month && a->date.year == b->date.year &&
+           strcmp(a->type, b->type) == 0 && strcmp(a->category, b->category) == 0 &&
+           strcmp(a->description, b->description) == 0;
+}
+
+typedef struct {
+    int* ids;
+    int count;
+    int capacity;
+} IdList;
+
+static int visitArchivedId(const Transaction* t, void* ctx) {
+    IdList* list = (IdList*)ctx;
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        int* grown = (int*)realloc(list->ids, sizeof(int) * capacity);
+        if (!grown) return 0;
+        list->ids = grown;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = t->id;
+    return 1;
+}
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Drops rows that have since been archived, keeping the order of the rest.
+// Returns how many are left.
+static int dropArchived(AppState* s, Transaction* rows, int n) {
+    ArchiveSummary archived;
+    if (!readArchiveSummary(s->filename, &archived)) return n;
+    IdList list;
+    memset(&list, 0, sizeof(list));
+    scanArchive(s->filename, INT_MIN, INT_MAX, visitArchivedId, &list);
+    qsort(list.ids, list.count, sizeof(int), compareInts);
+
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (rows[i].id > archived.maxId || !bsearch(&rows[i].id, list.ids, list.count, sizeof(int), compareInts)) {
+            rows[kept++] = rows[i];
+        }
+    }
+    free(list.ids);
+    return kept;
+}
+
+// Returning to a version is one record in the history. The data file and
+// its derived state then catch up through the rows that differ, with a
+// single save. Rows archived since that version stay in the archive, so
+// the result is then recorded as a bulk change rather than as the version.
+void cmdRollback(AppState* s, long version) {
+    VersionRecord target;
+    if (!findVersion(s->filename, version, &target)) {
+        statusPrintf("Error: Version %ld not found.\n", version);
+        return;
+    }
+    Transaction* rows;
+    int n = versionRows(s->filename, &target, &rows);
+    if (n != target.count) {
+        statusPrintf("Error: Could not read version %ld.\n", version);
+        free(rows);
+        return;
+    }
+    int archived = n - dropArchived(s, rows, n);
+    n -= archived;
+
+    const Transaction** current = (const Transaction**)malloc(sizeof(Transaction*) * (s->count + 1));
+    int m = 0;
+    for (Node* temp = s->head; temp != NULL && m < s->count; temp = temp->next) current[m++] = &temp->data;
+    qsort(current, m, sizeof(Transaction*), compareIds);
+
+    // Merge both id-ordered sequences into the rows to drop and to restore.
+    Transaction* removed = (Transaction*)malloc(sizeof(Transaction) * (m + 1));
+    Transaction* added = (Transaction*)malloc(sizeof(Transaction) * (n + 1));
+    int nRemoved = 0, nAdded = 0, i = 0, j = 0;
+    while (i < m || j < n) {
+        if (j == n || (i < m && current[i]->id < rows[j].id)) {
+            removed[nRemoved++] = *current[i++];
+        } else if (i == m || rows[j].id < current[i]->id) {
+            added[nAdded++] = rows[j++];
+        } else {
+            if (!sameRow(current[i], &rows[j])) {
+                removed[nRemoved++] = *current[i];
+                added[nAdded++] = rows[j];
+            }
+            i++;
+            j++;
+        }
+    }
+    free(current);
+
+    // Unless rows were left in the archive, the rollback record below is
+    // this change's version.
+    long now;
+    if (archived) {
+        if (nRemoved + nAdded > 0) applyBulk(s, removed, nRemoved, added, nAdded, 1);
+        VersionRecord tip;
+        now = latestVersion(s->filename, &tip);
+    } else {
+        applyBulk(s, removed, nRemoved, added, nAdded, 0);
+        now = appendRollback(s->filename, &target);
+    }
+    statusPrintf("Rolled back to version %ld as version %ld (%d removed, %d restored).\n", version, now, nRemoved, nAdded);
+    if (archived) statusPrintf("%d archived transaction(s) were left in the archive.\n", archived);
+    free(removed);
+    free(added);
+    free(rows);
+}
+
+// Moves every row dated before the cutoff into a new archive segment. The
+// segment is written as pending, the data file is saved without the rows
+// (right away, even under write-behind) and only then is the segment
+// committed, so the rows are never counted in both places. If the save
+// fails the segment is dropped; after a crash settleArchive() finishes
+// whichever step was interrupted.
+void cmdArchive(AppState* s, Date cutoff) {
+    int before = dateKey(cutoff);
+    Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * (s->count + 1));
+    int n = 0;
+    for (Node* temp = s->head; temp != NULL && n < s->count; temp = temp->next) {
+        if (dateKey(temp->data.date) < before) rows[n++] = temp->data;
+    }
+    if (n == 0) {
+        statusPrintf("No transactions before %02d/%02d/%04d to archive.\n", cutoff.day, cutoff.month, cutoff.year);
+        free(rows);
+        return;
+    }
+    long segment;
+    if (!appendArchiveSegment(s->filename, rows, n, &segment)) {
+        statusPrintf("Error: Could not write the archive.\n");
+        free(rows);
+        return;
+    }
+    qsort(rows, n, sizeof(Transaction), compareRowIds);
+
+    int wasDeferred = s->deferSaves, failedBefore = s->saveFailed;
+    s->deferSaves = 0;
+    s->saveFailed = 0;
+    applyBulk(s, rows, n, NULL, 0, 1);
+    s->deferSaves = wasDeferred;
+    if (s->saveFailed) {
+        discardArchiveSegment(s->filename, segment);
+        statusPrintf("Error: Could not save %s; nothing was archived.\n", s->filename);
+    } else {
+        commitArchiveSegment(s->filename, segment);
+        statusPrintf("Archived %d transaction(s) dated before %02d/%02d/%04d.\n", n, cutoff.day, cutoff.month, cutoff.year);
+    }
+    s->saveFailed |= failedBefore;
+    free(rows);
+}
+
+// Adds rows that already carry their ids in one bulk change. Imports are
+// not pushed on the undo stack.
+void cmdImport(AppState* s, Transaction* rows, int n) {
+    if (n <= 0) return;
+    applyBulk(s, NULL, 0, rows, n, 1);
+}
+
+// Returns 1 if t must not be posted under the given --dedupe mode.
+int rejectDuplicate(AppState* s, const Transaction* t, int dedupe) {
+    return rejectBatchDuplicate(s, NULL, t, dedupe);
+}
+
+// Same, also counting the rows already accepted into 'batch' (which are
+// not in the store yet); t is added to it unless rejected.
+int rejectBatchDuplicate(AppState* s, FingerprintIndex* batch, const Transaction* t, int dedupe) {
+    if (dedupe == DEDUPE_OFF) return 0;
+    ensureLoaded(s, NEED_FINGERPRINTS);
+    int duplicate = isDuplicate(&s->fingerprints, t) || (batch && isDuplicate(batch, t));
+    if (duplicate && dedupe == DEDUPE_REJECT) {
+        statusPrintf("Duplicate rejected: %02d/%02d/%04d %.2f %s %s\n",
+               t->date.day, t->date.month, t->date.year, t->amount, t->category, t->description);
+        return 1;
+    }
+    if (duplicate) {
+        statusPrintf("Warning: possible duplicate: %02d/%02d/%04d %.2f %s %s\n",
+               t->date.day, t->date.month, t->date.year, t->amount, t->category, t->description);
+    }
+    if (batch) fingerprintAdd(batch, t);
+    return 0;
+}
+
+void cmdProcessRecurring(AppState* s, int dedupe) {
+    if (isQueueEmpty(s->recurringQueue)) {
+        statusPrintf("No recurring payments to process.\n");
+    } else {
+        Transaction t = dequeue(s->recurringQueue);
+        t.id = getNextId(s);
+        
+        if (rejectDuplicate(s, &t, dedupe)) {
+            if (!deferSave(s, DIRTY_RECURRING)) saveQueue(s->recurringQueue, "recurring.txt");
+            return;
+        }
+        cmdAdd(s, t);
+        if (!deferSave(s, DIRTY_RECURRING)) saveQueue(s->recurringQueue, "recurring.txt");
+        statusPrintf("Processed recurring payment: %s - %.2f\n", t.description, t.amount);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "common.h"
+#include "appstate.h"
+
+// Mutations shared by the CLI, the interactive menu and libexpense. Each
+// keeps every loaded subsystem (totals, journal, views, budgets, indexes)
+// in step and saves the data file.
+int getNextId(AppState* s);
+void cmdAdd(AppState* s, Transaction t);
+void cmdDelete(AppState* s, int id);
+void cmdUndo(AppState* s);
+void cmdRollback(AppState* s, long version);
+void cmdArchive(AppState* s, Date cutoff);
+void cmdImport(AppState* s, Transaction* rows, int n);
+int rejectDuplicate(AppState* s, const Transaction* t, int dedupe);
+int rejectBatchDuplicate(AppState* s, FingerprintIndex* batch, const Transaction* t, int dedupe);
+void cmdProcessRecurring(AppState* s, int dedupe);
+
+#endif
@@ -0,0 +1,91 @@
+#define _DEFAULT_SOURCE  // usleep
+#include "commit.h"
+#include "file_ops.h"
+#include "lock.h"
+#include "snapshot.h"
+#include "metrics.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Files that are only ever appended to. Rewritten files (the data file,
+// undo stack, recurring queue, budgets) are synced before their rename,
+// and the archive before its segment is committed.
+static const char* appendedFiles[] = {"journal", "alerts", "history", "versions"};
+
+static void sleepMs(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+static long readDurable(const char* filename) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "durable");
+    FILE* fp = fopen(path, "r");
+    long gen = -1;
+    if (fp) {
+        if (fscanf(fp, "%ld", &gen) != 1) gen = -1;
+        fclose(fp);
+    }
+    return gen;
+}
+
+static void writeDurable(const char* filename, long gen) {
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), filename, "durable");
+    FILE* fp = openForReplace(path, "w", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+    fprintf(fp, "%ld\n", gen);
+    commitReplace(fp, tmpPath, path);
+}
+
+static int syncAccount(const char* filename) {
+    int ok = 1;
+    char path[256];
+    for (size_t i = 0; i < sizeof(appendedFiles) / sizeof(appendedFiles[0]); i++) {
+        sidecarPath(path, sizeof(path), filename, appendedFiles[i]);
+        ok = syncFile(path) && ok;
+    }
+    // The undo stack and recurring queue live in the working directory.
+    ok = syncDirectoryOf("undo_stack.txt") && ok;
+    return syncDirectoryOf(filename) && ok;
+}
+
+// Must be called without holding the account lock.
+int durableCommit(AppState* s, int windowMs, CommitResult* result) {
+    double start = monotonicMs();
+    result->generation = s->generation;
+    result->batched = 0;
+    result->synced = 0;
+
+    int commitLock = acquireNamedLock(s->filename, "commit", LOCK_WRITE);
+    long durable = readDurable(s->filename);
+    int ok = 1;
+
+    if (durable < s->generation) {
+        if (windowMs > 0) sleepMs(windowMs);
+
+        // Wait out any writer still mid-save, then cover everything so far.
+        int dataLock = acquireLock(s->filename, LOCK_READ);
+        int entries;
+        long gen = currentGeneration(s->filename, &entries);
+        releaseLock(dataLock);
+        if (gen < s->generation) gen = s->generation;
+
+        ok = syncAccount(s->filename);
+        if (ok) writeDurable(s->filename, gen);
+        result->batched = (int)(gen - (durable > 0 ? durable : 0));
+        result->synced = 1;
+        durable = gen;
+    }
+
+    releaseLock(commitLock);
+    result->durableGeneration = durable;
+    result->latencyMs = monotonicMs() - start;
+    return ok;
+}
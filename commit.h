@@ -0,0 +1,28 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include "common.h"
+#include "appstate.h"
+
+#define DEFAULT_COMMIT_WINDOW_MS 2
+
+// Group commit. Rewritten files are fsynced before they are renamed into
+// place (see commitReplaceSynced); what is left is the directory entries
+// and the appended files. After a mutating command has released the
+// account lock it calls durableCommit(), which makes its generation
+// durable. Whoever holds <file>.commit first becomes the leader: it waits
+// one commit window so that concurrent writers can land their changes,
+// then fsyncs the directory and appended files once and records the
+// generation covered in <file>.durable. Writers queued behind it find
+// their generation already covered and return without an fsync.
+typedef struct {
+    long generation;
+    long durableGeneration;
+    int batched;
+    int synced;
+    double latencyMs;
+} CommitResult;
+
+int durableCommit(AppState* s, int windowMs, CommitResult* result);
+
+#endif
@@ -0,0 +1,438 @@
+#include "csv.h"
+#include "file_ops.h"
+#include "stream.h"
+#include "archive.h"
+#include <ctype.h>
+#include <limits.h>
+
+static const char* const fieldNames[CSV_COLUMNS] = {
+    "id", "date", "day", "month", "year", "amount", "type", "category", "description"
+};
+
+// Header names recognised for each field, besides the field name itself.
+static const char* const headerAliases[CSV_COLUMNS][5] = {
+    {NULL},
+    {"transaction date", "posted date", "booking date", "value date", NULL},
+    {NULL},
+    {NULL},
+    {NULL},
+    {"value", "sum", NULL},
+    {"kind", NULL},
+    {NULL},
+    {"desc", "memo", "details", "narrative", "payee"},
+};
+
+static char delimiterFor(const char* path) {
+    size_t len = strlen(path);
+    if (len >= 4) {
+        const char* ext = path + len - 4;
+        if (ext[0] == '.' && tolower((unsigned char)ext[1]) == 't' && tolower((unsigned char)ext[2]) == 's' &&
+            tolower((unsigned char)ext[3]) == 'v') {
+            return '\t';
+        }
+    }
+    return ',';
+}
+
+CsvReader* openCsv(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    CsvReader* r = (CsvReader*)malloc(sizeof(CsvReader));
+    if (!r) {
+        fclose(fp);
+        return NULL;
+    }
+    r->fp = fp;
+    r->delimiter = delimiterFor(path);
+    r->len = 0;
+    r->pos = 0;
+    r->line = 1;
+    r->nextLine = 1;
+    r->fieldCount = 0;
+    r->truncated = 0;
+    return r;
+}
+
+void closeCsv(CsvReader* r) {
+    if (!r) return;
+    fclose(r->fp);
+    free(r);
+}
+
+static int nextChar(CsvReader* r) {
+    if (r->pos == r->len) {
+        r->len = fread(r->buf, 1, CSV_BUF_SIZE, r->fp);
+        r->pos = 0;
+        if (r->len == 0) return EOF;
+    }
+    return (unsigned char)r->buf[r->pos++];
+}
+
+static int peekChar(CsvReader* r) {
+    int c = nextChar(r);
+    if (c != EOF) r->pos--;
+    return c;
+}
+
+static void appendChar(CsvReader* r, int index, size_t* n, int c) {
+    if (index >= CSV_MAX_FIELDS) return;
+    if (*n < CSV_FIELD_SIZE - 1) r->fields[index][(*n)++] = (char)c;
+    else r->truncated = 1;
+}
+
+static void endField(CsvReader* r, int* index, size_t* n) {
+    if (*index < CSV_MAX_FIELDS) {
+        r->fields[*index][*n] = '\0';
+        r->fieldCount = *index + 1;
+    }
+    (*index)++;
+    *n = 0;
+}
+
+// Reads one record into r->fields. Returns 0 at end of file.
+int readCsvRecord(CsvReader* r) {
+    int c = nextChar(r);
+    if (c == EOF) return 0;
+
+    r->line = r->nextLine;
+    r->fieldCount = 0;
+    r->truncated = 0;
+    int index = 0, inQuotes = 0;
+    size_t n = 0;
+    for (; c != EOF; c = nextChar(r)) {
+        if (inQuotes) {
+            if (c == '"') {
+                if (peekChar(r) == '"') appendChar(r, index, &n, nextChar(r));
+                else inQuotes = 0;
+            } else {
+                if (c == '\n') r->nextLine++;
+                appendChar(r, index, &n, c);
+            }
+        } else if (c == '"' && n == 0) {
+            inQuotes = 1;
+        } else if (c == r->delimiter) {
+            endField(r, &index, &n);
+        } else if (c == '\n') {
+            r->nextLine++;
+            break;
+        } else if (c == '\r' && peekChar(r) == '\n') {
+            continue;
+        } else {
+            appendChar(r, index, &n, c);
+        }
+    }
+    endField(r, &index, &n);
+    return 1;
+}
+
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) s++;
+    size_t len = strlen(s);
+    while (len > 0 && isspace((unsigned char)s[len - 1])) s[--len] = '\0';
+    return s;
+}
+
+static int equalsNoCase(const char* a, const char* b) {
+    while (*a && *b && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static int fieldForHeader(const char* header) {
+    for (int f = 0; f < CSV_COLUMNS; f++) {
+        if (equalsNoCase(header, fieldNames[f])) return f;
+        for (int i = 0; i < 5 && headerAliases[f][i]; i++) {
+            if (equalsNoCase(header, headerAliases[f][i])) return f;
+        }
+    }
+    return -1;
+}
+
+// "field=Header" or "field=N" (1-based), comma separated.
+static int applyMapping(CsvReader* r, const char* mapping, int* column) {
+    char buf[512];
+    snprintf(buf, sizeof(buf), "%s", mapping);
+    for (char* entry = strtok(buf, ","); entry != NULL; entry = strtok(NULL, ",")) {
+        char* eq = strchr(entry, '=');
+        int field = -1;
+        if (eq) {
+            *eq = '\0';
+            for (int f = 0; f < CSV_COLUMNS; f++) {
+                if (equalsNoCase(trim(entry), fieldNames[f])) field = f;
+            }
+        }
+        if (field < 0) {
+            printf("Error: Bad column mapping '%s'. Use field=Header or field=N.\n", entry);
+            return 0;
+        }
+        char* target = trim(eq + 1);
+        char* end;
+        long index = strtol(target, &end, 10);
+        column[field] = -1;
+        if (*target && *end == '\0') {
+            column[field] = (int)index - 1;
+        } else {
+            for (int i = 0; i < r->fieldCount; i++) {
+                if (equalsNoCase(trim(r->fields[i]), target)) column[field] = i;
+            }
+        }
+        if (column[field] < 0 || column[field] >= CSV_MAX_FIELDS) {
+            printf("Error: No column '%s' for %s.\n", target, fieldNames[field]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char* columnValue(CsvReader* r, const int* column, int field) {
+    int i = column[field];
+    if (i < 0 || i >= r->fieldCount) return "";
+    return trim(r->fields[i]);
+}
+
+static int daysInMonth(int month, int year) {
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) return 29;
+    return days[month - 1];
+}
+
+// YYYY-MM-DD, YYYY/MM/DD, DD/MM/YYYY or DD.MM.YYYY.
+static int parseDateText(const char* text, Date* d) {
+    int a, b, c, used = -1;
+    char sep1, sep2;
+    if (sscanf(text, "%d%c%d%c%d%n", &a, &sep1, &b, &sep2, &c, &used) != 5 || text[used] != '\0' || sep1 != sep2) {
+        return 0;
+    }
+    if (sep1 != '-' && sep1 != '/' && sep1 != '.') return 0;
+    if (a > 31) {
+        d->year = a;
+        d->month = b;
+        d->day = c;
+    } else {
+        d->day = a;
+        d->month = b;
+        d->year = c;
+    }
+    return 1;
+}
+
+static int parseInt(const char* text, int* value) {
+    char* end;
+    long v = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0') return 0;
+    *value = (int)v;
+    return 1;
+}
+
+// The data file separates type and category by spaces and ends each row
+// with a newline, so those cannot appear inside the stored values. Both
+// return 1 if the stored value differs from the input (apart from the
+// fallback for an empty one).
+static int storeToken(char* dst, size_t size, const char* src, const char* fallback) {
+    if (*src == '\0') src = fallback;
+    size_t n = 0;
+    int changed = 0;
+    for (; *src && n < size - 1; src++) {
+        changed |= isspace((unsigned char)*src) != 0;
+        dst[n++] = isspace((unsigned char)*src) ? '_' : *src;
+    }
+    dst[n] = '\0';
+    return changed || *src != '\0';
+}
+
+static int storeText(char* dst, size_t size, const char* src, const char* fallback) {
+    if (*src == '\0') src = fallback;
+    size_t n = 0;
+    int changed = 0;
+    for (; *src && n < size - 1; src++) {
+        int blank = *src == '\n' || *src == '\r' || *src == '\t';
+        changed |= blank;
+        dst[n++] = blank ? ' ' : *src;
+    }
+    dst[n] = '\0';
+    return changed || *src != '\0';
+}
+
+static void reportAltered(CsvReader* r, const char* field, const char* stored, int* altered) {
+    if (++(*altered) <= CSV_MAX_REPORTED) {
+        printf("Line %ld: %s changed to fit the data file: \"%s\".\n", r->line, field, stored);
+    }
+}
+
+// Returns NULL if the record is a valid row, else the reason it is not.
+// Values that had to be changed to be stored are reported and counted in
+// *altered.
+static const char* parseRow(CsvReader* r, const int* column, Transaction* t, int* altered) {
+    if (r->truncated) return "field longer than 255 characters";
+
+    if (column[CSV_DATE] >= 0) {
+        if (!parseDateText(columnValue(r, column, CSV_DATE), &t->date)) return "unreadable date";
+    } else if (!parseInt(columnValue(r, column, CSV_DAY), &t->date.day) ||
+               !parseInt(columnValue(r, column, CSV_MONTH), &t->date.month) ||
+               !parseInt(columnValue(r, column, CSV_YEAR), &t->date.year)) {
+        return "unreadable date";
+    }
+    if (t->date.year < 1 || t->date.year > 9999 || t->date.month < 1 || t->date.month > 12 ||
+        t->date.day < 1 || t->date.day > daysInMonth(t->date.month, t->date.year)) {
+        return "date out of range";
+    }
+
+    const char* amountText = columnValue(r, column, CSV_AMOUNT);
+    char* end;
+    double amount = strtod(amountText, &end);
+    if (*amountText == '\0' || *end != '\0' || amount != amount) return "amount is not a number";
+    if (amount > 1e12 || amount < -1e12) return "amount out of range";
+
+    // The sign only picks the type when there is no Type column value;
+    // next to an explicit type a negative amount is ambiguous.
+    const char* type = columnValue(r, column, CSV_TYPE);
+    if (*type == '\0') {
+        type = amount < 0 ? "Expense" : "Income";
+    } else if (amount < 0) {
+        return "negative amount with an explicit type";
+    } else if (equalsNoCase(type, "income")) {
+        type = "Income";
+    } else if (equalsNoCase(type, "expense")) {
+        type = "Expense";
+    } else {
+        return "type must be Income or Expense";
+    }
+    t->amount = amount < 0 ? -amount : amount;
+    strcpy(t->type, type);
+    if (storeToken(t->category, MAX_CAT, columnValue(r, column, CSV_CATEGORY), "Uncategorized")) {
+        reportAltered(r, "category", t->category, altered);
+    }
+    if (storeText(t->description, MAX_DESC, columnValue(r, column, CSV_DESCRIPTION), "-")) {
+        reportAltered(r, "description", t->description, altered);
+    }
+    t->id = 0;
+    return NULL;
+}
+
+int importCsv(const char* path, const char* mapping, Transaction** rows, int* rejected) {
+    *rows = NULL;
+    *rejected = 0;
+    CsvReader* r = openCsv(path);
+    if (!r) {
+        printf("Error: Cannot open %s.\n", path);
+        return -1;
+    }
+    if (!readCsvRecord(r)) {
+        printf("Error: %s is empty.\n", path);
+        closeCsv(r);
+        return -1;
+    }
+
+    int column[CSV_COLUMNS];
+    for (int f = 0; f < CSV_COLUMNS; f++) column[f] = -1;
+    for (int i = r->fieldCount - 1; i >= 0; i--) {
+        int f = fieldForHeader(trim(r->fields[i]));
+        if (f >= 0) column[f] = i;
+    }
+    if (mapping && !applyMapping(r, mapping, column)) {
+        closeCsv(r);
+        return -1;
+    }
+    int hasDate = column[CSV_DATE] >= 0 || (column[CSV_DAY] >= 0 && column[CSV_MONTH] >= 0 && column[CSV_YEAR] >= 0);
+    if (!hasDate || column[CSV_AMOUNT] < 0) {
+        printf("Error: %s needs a date (or day, month, year) and an amount column.\n", path);
+        closeCsv(r);
+        return -1;
+    }
+
+    int n = 0, capacity = 1024, altered = 0;
+    *rows = (Transaction*)malloc(sizeof(Transaction) * capacity);
+    while (*rows && readCsvRecord(r)) {
+        if (r->fieldCount == 1 && *trim(r->fields[0]) == '\0') continue;
+        if (n == capacity) {
+            Transaction* grown = (Transaction*)realloc(*rows, sizeof(Transaction) * capacity * 2);
+            if (!grown) {
+                free(*rows);
+                *rows = NULL;
+                break;
+            }
+            *rows = grown;
+            capacity *= 2;
+        }
+        const char* error = parseRow(r, column, &(*rows)[n], &altered);
+        if (error) {
+            if (++(*rejected) <= CSV_MAX_REPORTED) printf("Line %ld: %s.\n", r->line, error);
+            continue;
+        }
+        n++;
+    }
+    closeCsv(r);
+    if (!*rows) {
+        printf("Error: Out of memory reading %s.\n", path);
+        return -1;
+    }
+    if (*rejected > CSV_MAX_REPORTED) printf("... %d more rejected row(s) not shown.\n", *rejected - CSV_MAX_REPORTED);
+    if (altered > CSV_MAX_REPORTED) printf("... %d more changed value(s) not shown.\n", altered - CSV_MAX_REPORTED);
+    return n;
+}
+
+typedef struct {
+    FILE* fp;
+    char delimiter;
+    long count;
+} CsvWriter;
+
+static void writeField(CsvWriter* w, const char* s) {
+    int quote = 0;
+    for (const char* p = s; *p && !quote; p++) {
+        quote = *p == w->delimiter || *p == '"' || *p == '\n' || *p == '\r';
+    }
+    if (!quote) {
+        fputs(s, w->fp);
+        return;
+    }
+    fputc('"', w->fp);
+    for (const char* p = s; *p; p++) {
+        if (*p == '"') fputc('"', w->fp);
+        fputc(*p, w->fp);
+    }
+    fputc('"', w->fp);
+}
+
+static int writeCsvRow(const Transaction* t, void* ctx) {
+    CsvWriter* w = (CsvWriter*)ctx;
+    char d = w->delimiter;
+    fprintf(w->fp, "%d%c%04d-%02d-%02d%c%.2f%c", t->id, d, t->date.year, t->date.month, t->date.day, d, t->amount, d);
+    writeField(w, t->type);
+    fputc(d, w->fp);
+    writeField(w, t->category);
+    fputc(d, w->fp);
+    writeField(w, t->description);
+    fputs("\r\n", w->fp);
+    w->count++;
+    return 1;
+}
+
+long exportCsv(const char* path, const char* filename, Node* head) {
+    char tmpPath[256];
+    CsvWriter w;
+    w.fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!w.fp) {
+        printf("Error: Cannot write %s.\n", path);
+        return -1;
+    }
+    setvbuf(w.fp, NULL, _IOFBF, CSV_BUF_SIZE);
+    w.delimiter = delimiterFor(path);
+    w.count = 0;
+
+    char d = w.delimiter;
+    fprintf(w.fp, "id%cdate%camount%ctype%ccategory%cdescription\r\n", d, d, d, d, d);
+    scanArchive(filename, INT_MIN, INT_MAX, writeCsvRow, &w);
+    if (head) {
+        for (Node* temp = head; temp != NULL; temp = temp->next) writeCsvRow(&temp->data, &w);
+    } else {
+        streamTransactions(filename, writeCsvRow, &w);
+    }
+    if (!commitReplace(w.fp, tmpPath, path)) {
+        printf("Error: Cannot write %s.\n", path);
+        return -1;
+    }
+    return w.count;
+}
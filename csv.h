@@ -0,0 +1,58 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include "common.h"
+#include "linkedlist.h"
+
+#define CSV_BUF_SIZE 65536
+#define CSV_MAX_FIELDS 32
+#define CSV_FIELD_SIZE 256
+#define CSV_MAX_REPORTED 50
+
+#define CSV_ID 0
+#define CSV_DATE 1
+#define CSV_DAY 2
+#define CSV_MONTH 3
+#define CSV_YEAR 4
+#define CSV_AMOUNT 5
+#define CSV_TYPE 6
+#define CSV_CATEGORY 7
+#define CSV_DESCRIPTION 8
+#define CSV_COLUMNS 9
+
+// RFC 4180 records (quoted fields, doubled quotes, embedded delimiters
+// and newlines, CRLF) read through fixed-size buffers: one input block
+// and one buffer per field, whatever the file size. Files ending in .tsv
+// use tabs instead of commas.
+typedef struct {
+    FILE* fp;
+    char delimiter;
+    char buf[CSV_BUF_SIZE];
+    size_t len;
+    size_t pos;
+    long line;          // line the current record starts on
+    long nextLine;
+    int fieldCount;
+    int truncated;      // a field did not fit CSV_FIELD_SIZE
+    char fields[CSV_MAX_FIELDS][CSV_FIELD_SIZE];
+} CsvReader;
+
+CsvReader* openCsv(const char* path);
+int readCsvRecord(CsvReader* r);
+void closeCsv(CsvReader* r);
+
+// Columns are matched to fields by header name (case-insensitive, with
+// common bank-export aliases), or by "field=Header" / "field=N" entries in
+// mapping, comma separated. Ids are always assigned on insert. Rows that
+// fail validation are reported with their line and skipped; categories
+// with whitespace, descriptions with line breaks or tabs, and values too
+// long to store are reported as they will be stored. Returns the
+// number of valid rows in *rows, or -1 if the file cannot be read.
+int importCsv(const char* path, const char* mapping, Transaction** rows, int* rejected);
+
+// Writes the archived rows, then the data file's in stored order (streamed
+// from the file if head is NULL). Returns the number of rows written, or
+// -1.
+long exportCsv(const char* path, const char* filename, Node* head);
+
+#endif
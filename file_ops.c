@@ -1,37 +1,135 @@
+#define _POSIX_C_SOURCE 200809L  // fileno, fsync
 #include "file_ops.h"
+#include "metrics.h"
+#include "cache.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdarg.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <io.h>
+#endif
 
-void saveToFile(Node* head, const char* filename) {
-    FILE* file = fopen(filename, "w");
+static int statusQuiet = 0;
+
+void setStatusQuiet(int quiet) {
+    statusQuiet = quiet;
+}
+
+void statusPrintf(const char* fmt, ...) {
+    if (statusQuiet) return;
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+static void writeRow(FILE* file, const Transaction* t) {
+    fprintf(file, "%d %d %d %d %.2f %s %s %s\n", 
+            t->id,
+            t->date.day, t->date.month, t->date.year,
+            t->amount,
+            t->type,
+            t->category,
+            t->description);
+}
+
+static void putBytes(unsigned char** p, const void* data, size_t n) {
+    memcpy(*p, data, n);
+    *p += n;
+}
+
+static void putString(unsigned char** p, const char* s, size_t max) {
+    size_t n = strnlen(s, max - 1);
+    *(*p)++ = (unsigned char)n;
+    putBytes(p, s, n);
+}
+
+static int getString(const unsigned char** p, const unsigned char* end, char* s, size_t max) {
+    if (*p >= end) return 0;
+    size_t n = *(*p)++;
+    if (n >= max || (size_t)(end - *p) < n) return 0;
+    memcpy(s, *p, n);
+    s[n] = '\0';
+    *p += n;
+    return 1;
+}
+
+size_t encodeRow(unsigned char* buf, const Transaction* t) {
+    unsigned char* p = buf;
+    int32_t fields[4] = {t->id, t->date.day, t->date.month, t->date.year};
+    int64_t cents = (int64_t)(t->amount * 100 + (t->amount < 0 ? -0.5 : 0.5));
+    putBytes(&p, fields, sizeof(fields));
+    putBytes(&p, &cents, sizeof(cents));
+    putString(&p, t->type, MAX_TYPE);
+    putString(&p, t->category, MAX_CAT);
+    putString(&p, t->description, MAX_DESC);
+    return (size_t)(p - buf);
+}
+
+int decodeRow(const unsigned char** p, const unsigned char* end, Transaction* t) {
+    if (end - *p < ROW_FIXED_BYTES) return 0;
+    int32_t fields[4];
+    int64_t cents;
+    memcpy(fields, *p, sizeof(fields));
+    memcpy(&cents, *p + sizeof(fields), sizeof(cents));
+    *p += ROW_FIXED_BYTES;
+    t->id = fields[0];
+    t->date.day = fields[1];
+    t->date.month = fields[2];
+    t->date.year = fields[3];
+    t->amount = cents / 100.0;
+    return getString(p, end, t->type, MAX_TYPE) &&
+           getString(p, end, t->category, MAX_CAT) &&
+           getString(p, end, t->description, MAX_DESC);
+}
+
+int saveToFile(Node* head, const char* filename) {
+    char tmpPath[256];
+    FILE* file = openForReplace(filename, "w", tmpPath, sizeof(tmpPath));
     if (file == NULL) {
-        printf("Error opening file for writing!\n");
-        return;
+        statusPrintf("Error opening file for writing!\n");
+        return 0;
     }
 
     Node* temp = head;
     while (temp != NULL) {
-        fprintf(file, "%d %d %d %d %.2f %s %s %s\n", 
-                temp->data.id,
-                temp->data.date.day, temp->data.date.month, temp->data.date.year,
-                temp->data.amount,
-                temp->data.type,
-                temp->data.category,
-                temp->data.description);
+        writeRow(file, &temp->data);
         temp = temp->next;
     }
 
-    fclose(file);
-    printf("Data saved successfully to %s\n", filename);
+    if (!commitReplaceSynced(file, tmpPath, filename)) {
+        statusPrintf("Error: Could not save %s.\n", filename);
+        return 0;
+    }
+    statusPrintf("Data saved successfully to %s\n", filename);
+    return 1;
+}
+
+// Same format as saveToFile, from a copy of the rows and without the
+// success message; used for background saves.
+int saveRowsToFile(const Transaction* rows, int n, const char* filename) {
+    char tmpPath[256];
+    FILE* file = openForReplace(filename, "w", tmpPath, sizeof(tmpPath));
+    if (file == NULL) return 0;
+    for (int i = 0; i < n; i++) writeRow(file, &rows[i]);
+    return commitReplaceSynced(file, tmpPath, filename);
 }
 
 void loadFromFile(Node** head, const char* filename) {
     FILE* file = fopen(filename, "r");
     if (file == NULL) {
-        printf("No existing data found. Starting fresh.\n");
+        statusPrintf("No existing data found. Starting fresh.\n");
         return;
     }
 
     Transaction t;
-    
+    Node* tail = *head;
+    while (tail != NULL && tail->next != NULL) tail = tail->next;
+
+    // Appends through a tail pointer; addNode would walk the list per row.
     while (fscanf(file, "%d %d %d %d %lf %s %s %[^\n]", 
                   &t.id, 
                   &t.date.day, &t.date.month, &t.date.year, 
@@ -39,9 +137,114 @@ void loadFromFile(Node** head, const char* filename) {
                   t.type, 
                   t.category, 
                   t.description) == 8) {
-        addNode(head, t);
+        Node* node = createNode(t);
+        if (!node) break;
+        if (tail) tail->next = node;
+        else *head = node;
+        tail = node;
+        metrics.rowsParsed++;
     }
 
     fclose(file);
-    printf("Data loaded successfully from %s\n", filename);
+    printLoadMessage(filename);
+}
+
+long fileSize(const char* filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) return -1;
+    return (long)st.st_size;
+}
+
+// Per-account side files live next to the data file, e.g.
+// transactions_bob.txt -> transactions_bob.txt.snap
+void sidecarPath(char* buf, size_t size, const char* filename, const char* ext) {
+    snprintf(buf, size, "%s.%s", filename, ext);
+}
+
+// Saves go to a private temp file that is renamed over the target, so a
+// concurrent reader sees either the old or the new file, never a partial one.
+// Each save gets its own temp name, even between threads of one process.
+static _Thread_local double saveStart;
+static atomic_uint saveSequence;
+
+FILE* openForReplace(const char* filename, const char* mode, char* tmpPath, size_t size) {
+    saveStart = metricsStart();
+    snprintf(tmpPath, size, "%s.tmp.%d.%u", filename, (int)getpid(), atomic_fetch_add(&saveSequence, 1));
+    return fopen(tmpPath, mode);
+}
+
+static int syncSaves = 1;
+
+void setSyncOnSave(int on) {
+    syncSaves = on;
+}
+
+static int replaceFile(FILE* fp, const char* tmpPath, const char* filename, int sync) {
+    long bytes = ftell(fp);
+    int ok = !ferror(fp) && fflush(fp) == 0;
+#ifdef _WIN32
+    if (ok && sync) ok = _commit(_fileno(fp)) == 0;
+#else
+    if (ok && sync) ok = fsync(fileno(fp)) == 0;
+#endif
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) {
+        remove(tmpPath);
+        return 0;
+    }
+#ifdef _WIN32
+    remove(filename);
+#endif
+    if (rename(tmpPath, filename) != 0) {
+        remove(tmpPath);
+        return 0;
+    }
+    metricsSave(bytes > 0 ? bytes : 0, saveStart);
+    return 1;
+}
+
+// For derived files that are checked when loaded and rebuilt if damaged.
+int commitReplace(FILE* fp, const char* tmpPath, const char* filename) {
+    return replaceFile(fp, tmpPath, filename, 0);
+}
+
+// For files that hold the account's data: the temp file reaches the disk
+// before the rename, so a crash cannot leave a truncated file under the
+// real name. Only the directory entry is left for the group commit.
+int commitReplaceSynced(FILE* fp, const char* tmpPath, const char* filename) {
+    return replaceFile(fp, tmpPath, filename, syncSaves);
+}
+
+// Forces a file's contents to stable storage. Missing files count as synced.
+int syncFile(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 1;
+#ifdef _WIN32
+    int ok = _commit(fd) == 0;
+#else
+    int ok = fsync(fd) == 0;
+#endif
+    close(fd);
+    return ok;
+}
+
+// Makes renames inside the file's directory durable (no-op on Windows).
+int syncDirectoryOf(const char* filename) {
+#ifdef _WIN32
+    (void)filename;
+    return 1;
+#else
+    char dir[256];
+    strncpy(dir, filename, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    char* slash = strrchr(dir, '/');
+    if (slash) *slash = '\0';
+    else strcpy(dir, ".");
+
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
 }
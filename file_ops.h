@@ -4,7 +4,32 @@
 #include "common.h"
 #include "linkedlist.h"
 
-void saveToFile(Node* head, const char* filename);
+// Binary form of a row for the sidecars: id and date as 32-bit ints, the
+// amount in cents as a 64-bit int, then type, category and description,
+// each behind a length byte. encodeRow writes at most ROW_MAX_BYTES and
+// returns the length; decodeRow advances *p and returns 0 on a short or
+// malformed row.
+#define ROW_FIXED_BYTES (4 * 4 + 8)
+#define ROW_MAX_BYTES (ROW_FIXED_BYTES + 3 + MAX_TYPE + MAX_CAT + MAX_DESC)
+
+size_t encodeRow(unsigned char* buf, const Transaction* t);
+int decodeRow(const unsigned char** p, const unsigned char* end, Transaction* t);
+
+int saveToFile(Node* head, const char* filename);
+int saveRowsToFile(const Transaction* rows, int n, const char* filename);
 void loadFromFile(Node** head, const char* filename);
+long fileSize(const char* filename);
+void sidecarPath(char* buf, size_t size, const char* filename, const char* ext);
+FILE* openForReplace(const char* filename, const char* mode, char* tmpPath, size_t size);
+int commitReplace(FILE* fp, const char* tmpPath, const char* filename);
+int commitReplaceSynced(FILE* fp, const char* tmpPath, const char* filename);
+void setSyncOnSave(int on);
+int syncFile(const char* filename);
+int syncDirectoryOf(const char* filename);
+
+// Status and error messages from loading, saving and the commands. A quiet
+// caller such as libexpense turns them off without touching stdout.
+void statusPrintf(const char* fmt, ...);
+void setStatusQuiet(int quiet);
 
 #endif
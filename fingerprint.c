@@ -0,0 +1,213 @@
+#include "fingerprint.h"
+#include "file_ops.h"
+#include <ctype.h>
+
+static uint64_t fnvBytes(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Case-insensitive, with runs of whitespace collapsed and the ends trimmed,
+// so "Coffee  Shop " and "coffee shop" hash the same.
+static uint64_t fnvNormalized(uint64_t h, const char* s) {
+    int pendingSpace = 0;
+    while (isspace((unsigned char)*s)) s++;
+    for (; *s; s++) {
+        if (isspace((unsigned char)*s)) {
+            pendingSpace = 1;
+            continue;
+        }
+        if (pendingSpace) {
+            h = fnvBytes(h, " ", 1);
+            pendingSpace = 0;
+        }
+        unsigned char c = (unsigned char)tolower((unsigned char)*s);
+        h = fnvBytes(h, &c, 1);
+    }
+    return fnvBytes(h, "\0", 1);
+}
+
+uint64_t transactionFingerprint(const Transaction* t) {
+    int fields[3] = {t->date.day, t->date.month, t->date.year};
+    long long cents = (long long)(t->amount * 100 + (t->amount < 0 ? -0.5 : 0.5));
+    uint64_t h = 14695981039346656037ULL;
+    h = fnvBytes(h, fields, sizeof(fields));
+    h = fnvBytes(h, &cents, sizeof(cents));
+    h = fnvNormalized(h, t->category);
+    h = fnvNormalized(h, t->description);
+    return h ? h : 1;
+}
+
+static size_t bloomBit(const FingerprintIndex* f, uint64_t key, int i) {
+    uint32_t h1 = (uint32_t)key;
+    uint32_t h2 = (uint32_t)(key >> 32) | 1;
+    return (size_t)(h1 + (uint32_t)i * h2) % f->bloomBits;
+}
+
+#define BLOOM_HASHES 4
+
+typedef struct {
+    char magic[4];
+    int version;
+    long generation;
+    long dataSize;
+    int used;
+} FingerprintHeader;
+
+static void setBloomBits(FingerprintIndex* f, uint64_t key) {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        size_t bit = bloomBit(f, key, i);
+        f->bloom[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+}
+
+// ~16 bits per expected row keeps false positives well under 1% at k=4.
+// Sized from the set's capacity, so it grows with the set; keys whose
+// count dropped to zero are left out.
+static void fillBloom(FingerprintIndex* f) {
+    free(f->bloom);
+    f->bloomBits = (size_t)f->capacity * 8;
+    f->bloom = (unsigned char*)calloc(f->bloomBits / 8, 1);
+    if (!f->bloom) return;
+    for (int i = 0; i < f->capacity; i++) {
+        if (f->keys[i] != 0 && f->counts[i] > 0) setBloomBits(f, f->keys[i]);
+    }
+}
+
+static int findSlot(const FingerprintIndex* f, uint64_t key) {
+    int mask = f->capacity - 1;
+    int i = (int)(key & (uint64_t)mask);
+    while (f->keys[i] != 0 && f->keys[i] != key) i = (i + 1) & mask;
+    return i;
+}
+
+static void growSet(FingerprintIndex* f) {
+    uint64_t* oldKeys = f->keys;
+    int* oldCounts = f->counts;
+    int oldCapacity = f->capacity;
+
+    f->capacity *= 2;
+    f->keys = (uint64_t*)calloc(f->capacity, sizeof(uint64_t));
+    f->counts = (int*)calloc(f->capacity, sizeof(int));
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldKeys[i] == 0) continue;
+        int slot = findSlot(f, oldKeys[i]);
+        f->keys[slot] = oldKeys[i];
+        f->counts[slot] = oldCounts[i];
+    }
+    free(oldKeys);
+    free(oldCounts);
+    fillBloom(f);
+}
+
+void initFingerprints(FingerprintIndex* f, int expected) {
+    int capacity = 64;
+    while (capacity < expected * 2) capacity *= 2;
+    f->capacity = capacity;
+    f->used = 0;
+    f->keys = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+    f->counts = (int*)calloc(capacity, sizeof(int));
+    f->bloom = NULL;
+    fillBloom(f);
+}
+
+void fingerprintAdd(FingerprintIndex* f, const Transaction* t) {
+    if (!f->keys) return;
+    uint64_t key = transactionFingerprint(t);
+    if ((f->used + 1) * 2 > f->capacity) growSet(f);
+    setBloomBits(f, key);
+
+    int slot = findSlot(f, key);
+    if (f->keys[slot] == 0) {
+        f->keys[slot] = key;
+        f->used++;
+    }
+    f->counts[slot]++;
+}
+
+// Bloom bits are left set; a stale bit only costs one extra set lookup.
+void fingerprintRemove(FingerprintIndex* f, const Transaction* t) {
+    if (!f->keys) return;
+    int slot = findSlot(f, transactionFingerprint(t));
+    if (f->keys[slot] != 0 && f->counts[slot] > 0) f->counts[slot]--;
+}
+
+int isDuplicate(FingerprintIndex* f, const Transaction* t) {
+    if (!f->keys) return 0;
+    uint64_t key = transactionFingerprint(t);
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        size_t bit = bloomBit(f, key, i);
+        if (!(f->bloom[bit / 8] & (1 << (bit % 8)))) return 0;
+    }
+    int slot = findSlot(f, key);
+    return f->keys[slot] != 0 && f->counts[slot] > 0;
+}
+
+int readFingerprints(FingerprintIndex* f, const char* path, long generation, long dataSize) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    FingerprintHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, FINGERPRINT_MAGIC, 4) == 0 &&
+             h.version == FINGERPRINT_VERSION &&
+             h.generation == generation &&
+             h.dataSize == dataSize &&
+             h.used >= 0;
+    if (ok) {
+        initFingerprints(f, h.used);
+        ok = f->keys && f->counts && f->bloom;
+    }
+    for (int i = 0; ok && i < h.used; i++) {
+        uint64_t key;
+        int count;
+        ok = fread(&key, sizeof(key), 1, fp) == 1 && fread(&count, sizeof(count), 1, fp) == 1 && key != 0;
+        if (!ok) break;
+        int slot = findSlot(f, key);
+        if (f->keys[slot] == 0) {
+            f->keys[slot] = key;
+            f->used++;
+        }
+        f->counts[slot] += count;
+        setBloomBits(f, key);
+    }
+    fclose(fp);
+
+    if (!ok) freeFingerprints(f);
+    return ok;
+}
+
+void writeFingerprints(const FingerprintIndex* f, const char* path, long generation, long dataSize) {
+    if (!f->keys) return;
+    char tmpPath[256];
+    FingerprintHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FINGERPRINT_MAGIC, 4);
+    h.version = FINGERPRINT_VERSION;
+    h.generation = generation;
+    h.dataSize = dataSize;
+    for (int i = 0; i < f->capacity; i++) {
+        if (f->keys[i] != 0 && f->counts[i] > 0) h.used++;
+    }
+
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+    fwrite(&h, sizeof(h), 1, fp);
+    for (int i = 0; i < f->capacity; i++) {
+        if (f->keys[i] == 0 || f->counts[i] <= 0) continue;
+        fwrite(&f->keys[i], sizeof(uint64_t), 1, fp);
+        fwrite(&f->counts[i], sizeof(int), 1, fp);
+    }
+    commitReplace(fp, tmpPath, path);
+}
+
+void freeFingerprints(FingerprintIndex* f) {
+    free(f->bloom);
+    free(f->keys);
+    free(f->counts);
+    memset(f, 0, sizeof(FingerprintIndex));
+}
@@ -0,0 +1,42 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include "common.h"
+#include <stdint.h>
+
+#define DEDUPE_OFF 0
+#define DEDUPE_REJECT 1
+#define DEDUPE_FLAG 2
+
+#define FINGERPRINT_MAGIC "EXPD"
+#define FINGERPRINT_VERSION 1
+
+// Set of 64-bit hashes of normalized (date, amount, category, description)
+// with a Bloom filter in front. Most lookups for new rows stop at the
+// filter; hits are confirmed in the hash set. Counts let identical rows
+// already in the store be removed one at a time.
+typedef struct {
+    unsigned char* bloom;
+    size_t bloomBits;
+    uint64_t* keys;
+    int* counts;
+    int capacity;
+    int used;
+} FingerprintIndex;
+
+uint64_t transactionFingerprint(const Transaction* t);
+void initFingerprints(FingerprintIndex* f, int expected);
+void fingerprintAdd(FingerprintIndex* f, const Transaction* t);
+void fingerprintRemove(FingerprintIndex* f, const Transaction* t);
+int isDuplicate(FingerprintIndex* f, const Transaction* t);
+
+// The set is kept in <file>.fingerprints as (key, count) pairs, valid only
+// for the generation and data file size it was written against. The
+// filter is rebuilt from the keys on load and whenever the set grows.
+// Only --dedupe runs load and save it; after other writes the next such
+// run rebuilds it from the rows.
+int readFingerprints(FingerprintIndex* f, const char* path, long generation, long dataSize);
+void writeFingerprints(const FingerprintIndex* f, const char* path, long generation, long dataSize);
+void freeFingerprints(FingerprintIndex* f);
+
+#endif
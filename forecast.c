@@ -0,0 +1,67 @@
+#include "forecast.h"
+#include "archive.h"
+
+typedef struct {
+    double income;
+    double expense;
+    double recurringIncome;   // change in the monthly recurring amounts
+    double recurringExpense;
+} ForecastBucket;
+
+static void addFlow(double* income, double* expense, const Transaction* t) {
+    if (strcmp(t->type, "Income") == 0) *income += t->amount;
+    else if (strcmp(t->type, "Expense") == 0) *expense += t->amount;
+}
+
+// Recurring payments are added where they start and carried forward by a
+// running sum, so each one costs O(1) whatever the horizon.
+void displayForecast(AppState* s, int months) {
+    if (months <= 0 || months > FORECAST_MAX_MONTHS) {
+        printf("Error: Forecast must cover 1 to %d months.\n", FORECAST_MAX_MONTHS);
+        return;
+    }
+    time_t now = time(NULL);
+    struct tm* tm = localtime(&now);
+    int first = (tm->tm_year + 1900) * 12 + tm->tm_mon;
+
+    ForecastBucket* buckets = (ForecastBucket*)calloc(months, sizeof(ForecastBucket));
+    ArchiveSummary archived;
+    readArchiveSummary(s->filename, &archived);
+    double openingIncome = archived.totalIncome, openingExpense = archived.totalExpense;
+
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+        int m = temp->data.date.year * 12 + temp->data.date.month - 1 - first;
+        if (m < 0) addFlow(&openingIncome, &openingExpense, &temp->data);
+        else if (m < months) addFlow(&buckets[m].income, &buckets[m].expense, &temp->data);
+    }
+    int scheduled = 0;
+    for (QueueNode* q = s->recurringQueue->front; q != NULL; q = q->next) {
+        int m = q->data.date.year * 12 + q->data.date.month - 1 - first;
+        if (m < 0) m = 0;
+        if (m >= months) continue;
+        addFlow(&buckets[m].recurringIncome, &buckets[m].recurringExpense, &q->data);
+        scheduled++;
+    }
+
+    double balance = openingIncome - openingExpense;
+    double recurringIncome = 0, recurringExpense = 0, totalIncome = 0, totalExpense = 0;
+    printf("\nForecast from %d recurring payment(s). Opening balance: %.2f\n", scheduled, balance);
+    printf("%-10s %-12s %-12s %-12s %-12s\n", "Month", "Income", "Expense", "Net", "Balance");
+    printf("----------------------------------------------------------\n");
+    for (int m = 0; m < months; m++) {
+        recurringIncome += buckets[m].recurringIncome;
+        recurringExpense += buckets[m].recurringExpense;
+        double income = buckets[m].income + recurringIncome;
+        double expense = buckets[m].expense + recurringExpense;
+        balance += income - expense;
+        totalIncome += income;
+        totalExpense += expense;
+        int month = first + m;
+        char label[16];
+        sprintf(label, "%02d/%04d", month % 12 + 1, month / 12);
+        printf("%-10s %-12.2f %-12.2f %-12.2f %-12.2f\n", label, income, expense, income - expense, balance);
+    }
+    printf("----------------------------------------------------------\n");
+    printf("%-10s %-12.2f %-12.2f %-12.2f %-12.2f\n", "Total", totalIncome, totalExpense, totalIncome - totalExpense, balance);
+    free(buckets);
+}
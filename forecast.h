@@ -0,0 +1,16 @@
+#ifndef FORECAST_H
+#define FORECAST_H
+
+#include "common.h"
+#include "appstate.h"
+
+#define FORECAST_MAX_MONTHS 1200
+
+// Cash-flow projection for the next 'months' months, starting with the
+// current one. Every scheduled recurring payment repeats monthly from the
+// month of its date; rows already recorded for those months are added on
+// top, and everything dated earlier (archive included) is the opening
+// balance.
+void displayForecast(AppState* s, int months);
+
+#endif
@@ -0,0 +1,532 @@
+#include "fuzzy.h"
+#include "file_ops.h"
+#include <ctype.h>
+
+#define MAX_QUERY_TOKENS 8
+#define GRAM_PAD '$'
+
+static void listPush(IntList* l, int value) {
+    if (l->count == l->capacity) {
+        int capacity = l->capacity ? l->capacity * 2 : 4;
+        int* grown = (int*)realloc(l->items, sizeof(int) * capacity);
+        if (!grown) return;
+        l->items = grown;
+        l->capacity = capacity;
+    }
+    l->items[l->count++] = value;
+}
+
+// Splits s into lowercase alphanumeric tokens. Returns the token count.
+static int tokenize(const char* s, char (*out)[MAX_TOKEN], int maxTokens) {
+    int n = 0, len = 0;
+    for (;; s++) {
+        if (isalnum((unsigned char)*s)) {
+            if (len < MAX_TOKEN - 1) out[n][len++] = (char)tolower((unsigned char)*s);
+        } else {
+            if (len > 0) {
+                out[n][len] = '\0';
+                len = 0;
+                if (++n == maxTokens) break;
+            }
+            if (*s == '\0') break;
+        }
+    }
+    return n;
+}
+
+static int gramsOf(const char* token, unsigned int* grams) {
+    char padded[MAX_TOKEN + 4];
+    int len = (int)strlen(token);
+    padded[0] = padded[1] = GRAM_PAD;
+    memcpy(padded + 2, token, len);
+    padded[len + 2] = padded[len + 3] = GRAM_PAD;
+    for (int i = 0; i < len + 2; i++) {
+        grams[i] = ((unsigned char)padded[i] << 16) | ((unsigned char)padded[i + 1] << 8) | (unsigned char)padded[i + 2];
+    }
+    return len + 2;
+}
+
+static unsigned int hashString(const char* s) {
+    unsigned int h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int findToken(FuzzyIndex* f, const char* token, int* slot) {
+    int mask = f->tokenSlotCount - 1;
+    int i = (int)(hashString(token) & mask);
+    while (f->tokenSlots[i]) {
+        int id = f->tokenSlots[i] - 1;
+        if (strcmp(f->tokens[id], token) == 0) {
+            *slot = i;
+            return id;
+        }
+        i = (i + 1) & mask;
+    }
+    *slot = i;
+    return -1;
+}
+
+static void growTokens(FuzzyIndex* f) {
+    f->tokenSlotCount *= 2;
+    free(f->tokenSlots);
+    f->tokenSlots = (int*)calloc(f->tokenSlotCount, sizeof(int));
+    for (int id = 0; id < f->tokenCount; id++) {
+        int slot;
+        findToken(f, f->tokens[id], &slot);
+        f->tokenSlots[slot] = id + 1;
+    }
+}
+
+static IntList* gramList(FuzzyIndex* f, unsigned int gram, int create) {
+    int mask = f->gramSlotCount - 1;
+    int i = (int)((gram * 2654435761u) & mask);
+    while (f->gramKeys[i] && f->gramKeys[i] != gram) i = (i + 1) & mask;
+    if (f->gramKeys[i] == gram) return &f->gramTokens[i];
+    if (!create) return NULL;
+
+    if ((f->gramCount + 1) * 2 > f->gramSlotCount) {
+        unsigned int* oldKeys = f->gramKeys;
+        IntList* oldLists = f->gramTokens;
+        int oldCount = f->gramSlotCount;
+        f->gramSlotCount *= 2;
+        f->gramKeys = (unsigned int*)calloc(f->gramSlotCount, sizeof(unsigned int));
+        f->gramTokens = (IntList*)calloc(f->gramSlotCount, sizeof(IntList));
+        mask = f->gramSlotCount - 1;
+        for (int j = 0; j < oldCount; j++) {
+            if (!oldKeys[j]) continue;
+            int k = (int)((oldKeys[j] * 2654435761u) & mask);
+            while (f->gramKeys[k]) k = (k + 1) & mask;
+            f->gramKeys[k] = oldKeys[j];
+            f->gramTokens[k] = oldLists[j];
+        }
+        free(oldKeys);
+        free(oldLists);
+        i = (int)((gram * 2654435761u) & mask);
+        while (f->gramKeys[i]) i = (i + 1) & mask;
+    }
+    f->gramKeys[i] = gram;
+    f->gramCount++;
+    return &f->gramTokens[i];
+}
+
+static int addToken(FuzzyIndex* f, const char* token) {
+    int slot;
+    int id = findToken(f, token, &slot);
+    if (id >= 0) return id;
+
+    if (f->tokenCount == f->tokenCapacity) {
+        int capacity = f->tokenCapacity * 2;
+        f->tokens = (char (*)[MAX_TOKEN])realloc(f->tokens, sizeof(*f->tokens) * capacity);
+        f->postings = (IntList*)realloc(f->postings, sizeof(IntList) * capacity);
+        f->tokenCapacity = capacity;
+    }
+    id = f->tokenCount++;
+    strcpy(f->tokens[id], token);
+    memset(&f->postings[id], 0, sizeof(IntList));
+    f->tokenSlots[slot] = id + 1;
+    if (f->tokenCount * 2 > f->tokenSlotCount) growTokens(f);
+
+    unsigned int grams[MAX_TOKEN + 2];
+    int n = gramsOf(token, grams);
+    for (int i = 0; i < n; i++) {
+        IntList* l = gramList(f, grams[i], 1);
+        if (l->count == 0 || l->items[l->count - 1] != id) listPush(l, id);
+    }
+    return id;
+}
+
+void buildFuzzyIndex(FuzzyIndex* f, Node* head) {
+    memset(f, 0, sizeof(FuzzyIndex));
+    for (Node* temp = head; temp != NULL; temp = temp->next) f->rowCount++;
+
+    f->head = head;
+    f->tokenCapacity = 256;
+    f->tokens = (char (*)[MAX_TOKEN])malloc(sizeof(*f->tokens) * f->tokenCapacity);
+    f->postings = (IntList*)malloc(sizeof(IntList) * f->tokenCapacity);
+    f->tokenSlotCount = 512;
+    f->tokenSlots = (int*)calloc(f->tokenSlotCount, sizeof(int));
+    f->gramSlotCount = 1024;
+    f->gramKeys = (unsigned int*)calloc(f->gramSlotCount, sizeof(unsigned int));
+    f->gramTokens = (IntList*)calloc(f->gramSlotCount, sizeof(IntList));
+
+    char words[MAX_DESC / 2 + 1][MAX_TOKEN];
+    int row = 0;
+    for (Node* temp = head; temp != NULL; temp = temp->next, row++) {
+        int n = tokenize(temp->data.description, words, MAX_DESC / 2 + 1);
+        for (int i = 0; i < n; i++) {
+            int id = addToken(f, words[i]);
+            IntList* p = &f->postings[id];
+            if (p->count == 0 || p->items[p->count - 1] != row) listPush(p, row);
+        }
+    }
+}
+
+typedef struct {
+    char magic[4];
+    int version;
+    long generation;
+    long dataSize;
+    int rowCount;
+    int tokenCount;
+    int postingCount;
+    int gramSlotCount;
+    int gramItemCount;
+} FuzzyHeader;
+
+// Writes the lists' start offsets (count + 1 of them) and then their items
+// back to back.
+static void writeLists(FILE* fp, const IntList* lists, int count) {
+    int start = 0;
+    for (int i = 0; i < count; i++) {
+        fwrite(&start, sizeof(int), 1, fp);
+        start += lists[i].count;
+    }
+    fwrite(&start, sizeof(int), 1, fp);
+    for (int i = 0; i < count; i++) {
+        if (lists[i].count > 0) fwrite(lists[i].items, sizeof(int), lists[i].count, fp);
+    }
+}
+
+static int totalItems(const IntList* lists, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) total += lists[i].count;
+    return total;
+}
+
+// Format: header, token strings, token postings, the gram keys slot by
+// slot, then the gram token lists.
+void saveFuzzyIndex(FuzzyIndex* f, AppState* s) {
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), s->filename, "fuzzy");
+
+    FuzzyHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FUZZY_MAGIC, 4);
+    h.version = FUZZY_VERSION;
+    h.generation = s->generation;
+    h.dataSize = fileSize(s->filename);
+    h.rowCount = f->rowCount;
+    h.tokenCount = f->tokenCount;
+    h.postingCount = totalItems(f->postings, f->tokenCount);
+    h.gramSlotCount = f->gramSlotCount;
+    h.gramItemCount = totalItems(f->gramTokens, f->gramSlotCount);
+
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(f->tokens, MAX_TOKEN, f->tokenCount, fp);
+    writeLists(fp, f->postings, f->tokenCount);
+    fwrite(f->gramKeys, sizeof(unsigned int), f->gramSlotCount, fp);
+    writeLists(fp, f->gramTokens, f->gramSlotCount);
+    commitReplace(fp, tmpPath, path);
+}
+
+// Row numbers in the postings are positions in the list, which only holds
+// while the data file is the one the index was built from.
+int loadFuzzyIndex(FuzzyIndex* f, AppState* s) {
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "fuzzy");
+    memset(f, 0, sizeof(FuzzyIndex));
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    FuzzyHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, FUZZY_MAGIC, 4) == 0 &&
+             h.version == FUZZY_VERSION &&
+             h.generation == s->generation &&
+             h.dataSize == fileSize(s->filename) &&
+             h.rowCount == s->count &&
+             h.tokenCount >= 0 && h.postingCount >= 0 &&
+             h.gramSlotCount > 0 && h.gramItemCount >= 0;
+    if (ok) {
+        f->tokensAt = (long)sizeof(h);
+        f->postingStartsAt = f->tokensAt + (long)MAX_TOKEN * h.tokenCount;
+        f->postingsAt = f->postingStartsAt + (long)sizeof(int) * (h.tokenCount + 1);
+        long gramKeysAt = f->postingsAt + (long)sizeof(int) * h.postingCount;
+        f->gramStartsAt = gramKeysAt + (long)sizeof(unsigned int) * h.gramSlotCount;
+        f->gramItemsAt = f->gramStartsAt + (long)sizeof(int) * (h.gramSlotCount + 1);
+        ok = fileSize(path) == f->gramItemsAt + (long)sizeof(int) * h.gramItemCount;
+
+        f->gramKeys = ok ? (unsigned int*)malloc(sizeof(unsigned int) * h.gramSlotCount) : NULL;
+        ok = f->gramKeys && fseek(fp, gramKeysAt, SEEK_SET) == 0 &&
+             fread(f->gramKeys, sizeof(unsigned int), h.gramSlotCount, fp) == (size_t)h.gramSlotCount;
+    }
+    if (!ok) {
+        free(f->gramKeys);
+        f->gramKeys = NULL;
+        fclose(fp);
+        return 0;
+    }
+
+    f->head = s->head;
+    f->rowCount = h.rowCount;
+    f->tokenCount = h.tokenCount;
+    f->gramSlotCount = h.gramSlotCount;
+    f->postingCount = h.postingCount;
+    f->gramItemCount = h.gramItemCount;
+    f->file = fp;
+    return 1;
+}
+
+// Reads list `index` of a table written by writeLists into out.
+static int readList(FuzzyIndex* f, long startsAt, long itemsAt, int itemCount, int index, IntList* out) {
+    int range[2];
+    out->count = 0;
+    if (fseek(f->file, startsAt + (long)sizeof(int) * index, SEEK_SET) != 0 ||
+        fread(range, sizeof(int), 2, f->file) != 2 ||
+        range[0] < 0 || range[0] > range[1] || range[1] > itemCount) {
+        return 0;
+    }
+    int n = range[1] - range[0];
+    if (n == 0) return 1;
+    if (n > out->capacity) {
+        int* grown = (int*)realloc(out->items, sizeof(int) * n);
+        if (!grown) return 0;
+        out->items = grown;
+        out->capacity = n;
+    }
+    if (fseek(f->file, itemsAt + (long)sizeof(int) * range[0], SEEK_SET) != 0 ||
+        fread(out->items, sizeof(int), n, f->file) != (size_t)n) {
+        return 0;
+    }
+    out->count = n;
+    return 1;
+}
+
+// The tokens sharing `gram`, copied into buf for a loaded index.
+static const IntList* gramTokensOf(FuzzyIndex* f, unsigned int gram, IntList* buf) {
+    int mask = f->gramSlotCount - 1;
+    int i = (int)((gram * 2654435761u) & mask);
+    for (int probes = 0; f->gramKeys[i] && f->gramKeys[i] != gram; probes++) {
+        if (probes == f->gramSlotCount) return NULL;
+        i = (i + 1) & mask;
+    }
+    if (f->gramKeys[i] != gram) return NULL;
+    if (!f->file) return &f->gramTokens[i];
+    return readList(f, f->gramStartsAt, f->gramItemsAt, f->gramItemCount, i, buf) ? buf : NULL;
+}
+
+static const IntList* postingsOf(FuzzyIndex* f, int token, IntList* buf) {
+    if (!f->file) return &f->postings[token];
+    return readList(f, f->postingStartsAt, f->postingsAt, f->postingCount, token, buf) ? buf : NULL;
+}
+
+static int tokenOf(FuzzyIndex* f, int token, char* out) {
+    if (!f->file) {
+        strcpy(out, f->tokens[token]);
+        return 1;
+    }
+    if (fseek(f->file, f->tokensAt + (long)MAX_TOKEN * token, SEEK_SET) != 0 ||
+        fread(out, MAX_TOKEN, 1, f->file) != 1) {
+        return 0;
+    }
+    out[MAX_TOKEN - 1] = '\0';
+    return 1;
+}
+
+// Levenshtein distance restricted to the diagonal band |i - j| <= maxDist.
+// Returns maxDist + 1 as soon as no cell in a row can still finish within
+// the bound, which is what keeps candidate verification cheap.
+int boundedEditDistance(const char* a, int la, const char* b, int lb, int maxDist) {
+    int over = maxDist + 1;
+    if (la - lb > maxDist || lb - la > maxDist) return over;
+    if (lb > 255) return over;
+
+    int rowA[256], rowB[256];
+    int* prev = rowA;
+    int* cur = rowB;
+    for (int j = 0; j <= lb; j++) prev[j] = j <= maxDist ? j : over;
+
+    for (int i = 1; i <= la; i++) {
+        int lo = i - maxDist > 1 ? i - maxDist : 1;
+        int hi = i + maxDist < lb ? i + maxDist : lb;
+        cur[0] = i <= maxDist ? i : over;
+        if (lo > 1) cur[lo - 1] = over;
+        int rowMin = lo == 1 ? cur[0] : over;
+
+        for (int j = lo; j <= hi; j++) {
+            int v = prev[j - 1] + (a[i - 1] != b[j - 1]);
+            if (prev[j] + 1 < v) v = prev[j] + 1;
+            if (cur[j - 1] + 1 < v) v = cur[j - 1] + 1;
+            if (v > over) v = over;
+            cur[j] = v;
+            if (v < rowMin) rowMin = v;
+        }
+        if (hi < lb) cur[hi + 1] = over;
+        if (rowMin > maxDist) return over;
+
+        int* swap = prev;
+        prev = cur;
+        cur = swap;
+    }
+    return prev[lb] <= maxDist ? prev[lb] : over;
+}
+
+typedef struct {
+    int row;
+    int score;
+    Transaction* t;
+} FuzzyHit;
+
+typedef struct {
+    FuzzyHit* items;
+    int count;
+    int capacity;
+} HitList;
+
+static void hitPush(HitList* l, int row, int score) {
+    if (l->count == l->capacity) {
+        int capacity = l->capacity ? l->capacity * 2 : 16;
+        FuzzyHit* grown = (FuzzyHit*)realloc(l->items, sizeof(FuzzyHit) * capacity);
+        if (!grown) return;
+        l->items = grown;
+        l->capacity = capacity;
+    }
+    l->items[l->count].row = row;
+    l->items[l->count].score = score;
+    l->items[l->count].t = NULL;
+    l->count++;
+}
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareRows(const void* a, const void* b) {
+    const FuzzyHit* ha = (const FuzzyHit*)a;
+    const FuzzyHit* hb = (const FuzzyHit*)b;
+    if (ha->row != hb->row) return ha->row - hb->row;
+    return ha->score - hb->score;
+}
+
+static int compareHits(const void* a, const void* b) {
+    const FuzzyHit* ha = (const FuzzyHit*)a;
+    const FuzzyHit* hb = (const FuzzyHit*)b;
+    if (ha->score != hb->score) return ha->score - hb->score;
+    return ha->row - hb->row;
+}
+
+// Collects (row, distance) for every row holding a token within maxDist of
+// qt, one entry per row with its closest distance, sorted by row.
+static void matchToken(FuzzyIndex* f, const char* qt, int maxDist, HitList* out) {
+    int lq = (int)strlen(qt);
+    unsigned int grams[MAX_TOKEN + 2];
+    int ng = gramsOf(qt, grams);
+    IntList candidates = {0};
+    IntList buf = {0};
+
+    // Each edit can destroy at most three of the query's trigrams, so a
+    // token needs that many shared grams; with too few grams every token
+    // is a candidate.
+    int threshold = ng - 3 * maxDist;
+    if (threshold > 0) {
+        for (int g = 0; g < ng; g++) {
+            const IntList* l = gramTokensOf(f, grams[g], &buf);
+            for (int i = 0; l && i < l->count; i++) listPush(&candidates, l->items[i]);
+        }
+        if (candidates.count > 0) qsort(candidates.items, candidates.count, sizeof(int), compareInts);
+    } else {
+        for (int t = 0; t < f->tokenCount; t++) listPush(&candidates, t);
+        threshold = 1;
+    }
+
+    out->count = 0;
+    for (int i = 0; i < candidates.count;) {
+        int t = candidates.items[i];
+        int shared = 0;
+        while (i < candidates.count && candidates.items[i] == t) {
+            shared++;
+            i++;
+        }
+        char tok[MAX_TOKEN];
+        if (shared < threshold || t < 0 || t >= f->tokenCount || !tokenOf(f, t, tok)) continue;
+        int d = boundedEditDistance(qt, lq, tok, (int)strlen(tok), maxDist);
+        if (d > maxDist) continue;
+
+        const IntList* p = postingsOf(f, t, &buf);
+        for (int k = 0; p && k < p->count; k++) hitPush(out, p->items[k], d);
+    }
+    free(candidates.items);
+    free(buf.items);
+
+    // Keep the closest distance per row.
+    if (out->count > 0) qsort(out->items, out->count, sizeof(FuzzyHit), compareRows);
+    int n = 0;
+    for (int i = 0; i < out->count; i++) {
+        if (n == 0 || out->items[n - 1].row != out->items[i].row) out->items[n++] = out->items[i];
+    }
+    out->count = n;
+}
+
+// Every query token must match some description token within maxDist;
+// rows are ranked by the summed distances, closest first. Work and memory
+// follow the matching postings, not the number of rows.
+void fuzzySearch(FuzzyIndex* f, const char* query, int maxDist, OutputWriter* w) {
+    char qtokens[MAX_QUERY_TOKENS][MAX_TOKEN];
+    int nq = tokenize(query, qtokens, MAX_QUERY_TOKENS);
+    HitList results = {0};
+    HitList matches = {0};
+
+    for (int q = 0; q < nq; q++) {
+        matchToken(f, qtokens[q], maxDist, q == 0 ? &results : &matches);
+        if (q == 0) continue;
+
+        // Both lists are sorted by row: keep rows in both, summing scores.
+        int n = 0;
+        for (int i = 0, j = 0; i < results.count && j < matches.count;) {
+            if (results.items[i].row < matches.items[j].row) {
+                i++;
+            } else if (results.items[i].row > matches.items[j].row) {
+                j++;
+            } else {
+                results.items[n] = results.items[i];
+                results.items[n++].score += matches.items[j].score;
+                i++;
+                j++;
+            }
+        }
+        results.count = n;
+        if (n == 0) break;
+    }
+
+    // Resolve row positions to transactions in one pass down the list.
+    int row = 0;
+    Node* temp = f->head;
+    int n = 0;
+    for (int i = 0; i < results.count; i++) {
+        while (temp != NULL && row < results.items[i].row) {
+            temp = temp->next;
+            row++;
+        }
+        if (temp == NULL) break;
+        results.items[i].t = &temp->data;
+        n++;
+    }
+    if (n > 0) qsort(results.items, n, sizeof(FuzzyHit), compareHits);
+
+    outBeginList(w, "search", ROW_FOUND);
+    for (int i = 0; i < n && outTransaction(w, results.items[i].t); i++);
+    outEndList(w, "No close matches found.");
+
+    free(results.items);
+    free(matches.items);
+}
+
+void freeFuzzyIndex(FuzzyIndex* f) {
+    for (int i = 0; f->postings && i < f->tokenCount; i++) free(f->postings[i].items);
+    for (int i = 0; f->gramTokens && i < f->gramSlotCount; i++) free(f->gramTokens[i].items);
+    if (f->file) fclose(f->file);
+    free(f->tokens);
+    free(f->postings);
+    free(f->tokenSlots);
+    free(f->gramKeys);
+    free(f->gramTokens);
+    memset(f, 0, sizeof(FuzzyIndex));
+}
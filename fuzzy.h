@@ -0,0 +1,65 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include "common.h"
+#include "linkedlist.h"
+#include "output.h"
+#include "appstate.h"
+
+#define MAX_TOKEN 32
+#define FUZZY_MAGIC "EXPF"
+#define FUZZY_VERSION 2
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+// Typo-tolerant description search. Descriptions are split into lowercase
+// word tokens; each distinct token keeps a posting list of the rows using
+// it, and every token is indexed by its padded trigrams. A query token
+// only gets an edit-distance check against tokens sharing enough trigrams
+// with it.
+//
+// A freshly built index lives in memory. One loaded from its sidecar keeps
+// only the gram keys in memory and seeks to the gram lists, tokens and
+// postings a query actually touches.
+typedef struct {
+    Node* head;
+    int rowCount;
+
+    char (*tokens)[MAX_TOKEN];
+    IntList* postings;
+    int tokenCount;
+    int tokenCapacity;
+    int* tokenSlots;
+    int tokenSlotCount;
+
+    unsigned int* gramKeys;
+    IntList* gramTokens;
+    int gramCount;
+    int gramSlotCount;
+
+    FILE* file;
+    long tokensAt;
+    long postingStartsAt;
+    long postingsAt;
+    long gramStartsAt;
+    long gramItemsAt;
+    int postingCount;
+    int gramItemCount;
+} FuzzyIndex;
+
+int boundedEditDistance(const char* a, int la, const char* b, int lb, int maxDist);
+void buildFuzzyIndex(FuzzyIndex* f, Node* head);
+
+// The index is kept in <file>.fuzzy, valid for the generation and data
+// file size it was built against (like the views), so repeated searches
+// only read back the parts they need.
+int loadFuzzyIndex(FuzzyIndex* f, AppState* s);
+void saveFuzzyIndex(FuzzyIndex* f, AppState* s);
+void fuzzySearch(FuzzyIndex* f, const char* query, int maxDist, OutputWriter* w);
+void freeFuzzyIndex(FuzzyIndex* f);
+
+#endif
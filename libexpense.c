@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L  // strdup
+#include "libexpense.h"
+#include "appstate.h"
+#include "commands.h"
+#include "snapshot.h"
+#include "lock.h"
+#include "cache.h"
+#include "commit.h"
+#include "archive.h"
+#include "file_ops.h"
+
+struct ExpenseAccount {
+    char* filename;
+    AppState state;
+    long dataGen;
+};
+
+struct ExpenseResult {
+    const Transaction** rows;
+    int count;
+    int capacity;
+};
+
+#define WRITE_NEEDS (NEED_TRANSACTIONS | NEED_UNDO | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES)
+
+// Takes the lock and drops the resident state if anyone else has written
+// since we last looked. Returns -1 if the lock cannot be taken.
+static int beginCall(ExpenseAccount* a, int mode, int needs) {
+    // The backend's status messages must not end up in the host's output.
+    setStatusQuiet(1);
+    int lock = acquireLock(a->filename, mode);
+    if (lock < 0) {
+        setStatusQuiet(0);
+        return -1;
+    }
+    long gen = dataGeneration(a->filename);
+    if (gen != a->dataGen) {
+        freeAppState(&a->state);
+        initAppState(&a->state, a->filename);
+        a->dataGen = gen;
+    }
+    ensureLoaded(&a->state, needs);
+    a->state.saveFailed = 0;
+    return lock;
+}
+
+static void endCall(int lock) {
+    releaseLock(lock);
+    setStatusQuiet(0);
+}
+
+// Returns 0 if the change could not be saved or made durable. The resident
+// state is then dropped, since it no longer matches the file.
+static int endWrite(ExpenseAccount* a, int lock, long startGeneration) {
+    AppState* s = &a->state;
+    int ok = !s->saveFailed;
+    if (s->generation > startGeneration) a->dataGen = bumpDataGeneration(a->filename);
+    if (ok && (!s->fromSnapshot || s->journalLength >= CHECKPOINT_INTERVAL)) writeSnapshot(s);
+    endCall(lock);
+    if (ok && s->generation > startGeneration) {
+        CommitResult commit;
+        ok = durableCommit(s, DEFAULT_COMMIT_WINDOW_MS, &commit);
+    }
+    if (!ok) a->dataGen = -1;
+    return ok;
+}
+
+ExpenseAccount* expenseOpen(const char* filename) {
+    ExpenseAccount* a = (ExpenseAccount*)malloc(sizeof(ExpenseAccount));
+    if (!a) return NULL;
+    a->filename = strdup(filename);
+    initAppState(&a->state, a->filename);
+    a->dataGen = -1;
+    return a;
+}
+
+void expenseClose(ExpenseAccount* a) {
+    if (!a) return;
+    freeAppState(&a->state);
+    free(a->filename);
+    free(a);
+}
+
+int expenseAdd(ExpenseAccount* a, int day, int month, int year, double amount,
+               const char* type, const char* category, const char* description) {
+    int lock = beginCall(a, LOCK_WRITE, WRITE_NEEDS);
+    if (lock < 0) return -1;
+    long startGeneration = a->state.generation;
+
+    Transaction t;
+    memset(&t, 0, sizeof(t));
+    t.id = getNextId(&a->state);
+    t.date = createDate(day, month, year);
+    t.amount = amount;
+    snprintf(t.type, MAX_TYPE, "%s", type);
+    snprintf(t.category, MAX_CAT, "%s", category);
+    snprintf(t.description, MAX_DESC, "%s", description);
+    cmdAdd(&a->state, t);
+
+    if (!endWrite(a, lock, startGeneration)) return -1;
+    return t.id;
+}
+
+int expenseDelete(ExpenseAccount* a, int id) {
+    int lock = beginCall(a, LOCK_WRITE, WRITE_NEEDS);
+    if (lock < 0) return -1;
+    long startGeneration = a->state.generation;
+    int found = findNode(a->state.head, id) != NULL;
+    if (found) cmdDelete(&a->state, id);
+    if (!endWrite(a, lock, startGeneration)) return -1;
+    return found;
+}
+
+int expenseUndo(ExpenseAccount* a) {
+    int lock = beginCall(a, LOCK_WRITE, WRITE_NEEDS);
+    if (lock < 0) return -1;
+    long startGeneration = a->state.generation;
+    int pending = !isStackEmpty(a->state.undoStack);
+    cmdUndo(&a->state);
+    if (!endWrite(a, lock, startGeneration)) return -1;
+    return pending;
+}
+
+static void resultAdd(ExpenseResult* r, const Transaction* t) {
+    if (r->count == r->capacity) {
+        r->capacity = r->capacity ? r->capacity * 2 : 16;
+        r->rows = (const Transaction**)realloc(r->rows, sizeof(Transaction*) * r->capacity);
+    }
+    r->rows[r->count++] = t;
+}
+
+static void collectAmount(const BSTNode* root, double amount, ExpenseResult* r) {
+    while (root != NULL) {
+        if (amount < root->data.amount) {
+            root = root->left;
+        } else {
+            if (amount == root->data.amount) resultAdd(r, &root->data);
+            root = root->right;
+        }
+    }
+}
+
+ExpenseResult* expenseSearch(ExpenseAccount* a, int field, const char* value) {
+    int needs = field == EXPENSE_BY_AMOUNT ? NEED_INDEX : NEED_TRANSACTIONS;
+    int lock = beginCall(a, LOCK_READ, needs);
+    if (lock < 0) return NULL;
+
+    ExpenseResult* r = (ExpenseResult*)calloc(1, sizeof(ExpenseResult));
+    if (field == EXPENSE_BY_AMOUNT) {
+        collectAmount(a->state.bstRoot, atof(value), r);
+    } else if (field == EXPENSE_BY_ID) {
+        Node* node = findNode(a->state.head, atoi(value));
+        if (node) resultAdd(r, &node->data);
+    } else {
+        for (Node* temp = a->state.head; temp != NULL; temp = temp->next) {
+            if (field == EXPENSE_ALL || strstr(temp->data.description, value) != NULL) {
+                resultAdd(r, &temp->data);
+            }
+        }
+    }
+
+    endCall(lock);
+    return r;
+}
+
+int expenseResultCount(const ExpenseResult* r) {
+    return r ? r->count : 0;
+}
+
+const Transaction* expenseResultRow(const ExpenseResult* r, int index) {
+    if (!r || index < 0 || index >= r->count) return NULL;
+    return r->rows[index];
+}
+
+// Copies up to max rows starting at offset into buf; returns how many.
+int expenseResultFetch(const ExpenseResult* r, int offset, Transaction* buf, int max) {
+    int n = 0;
+    while (r && offset + n < r->count && n < max) {
+        buf[n] = *r->rows[offset + n];
+        n++;
+    }
+    return n;
+}
+
+void expenseResultFree(ExpenseResult* r) {
+    if (!r) return;
+    free(r->rows);
+    free(r);
+}
+
+int expenseTotals(ExpenseAccount* a, const char* category, ExpenseTotals* out) {
+    int lock = beginCall(a, LOCK_READ, NEED_TRANSACTIONS);
+    if (lock < 0) return -1;
+    AppState* s = &a->state;
+    if (category == NULL) {
+        ArchiveSummary archived;
+        readArchiveSummary(s->filename, &archived);
+        out->count = s->count + archived.count;
+        out->totalIncome = s->totalIncome + archived.totalIncome;
+        out->totalExpense = s->totalExpense + archived.totalExpense;
+    } else {
+        memset(out, 0, sizeof(*out));
+        for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+            if (strcmp(temp->data.category, category) != 0) continue;
+            out->count++;
+            if (strcmp(temp->data.type, "Income") == 0) out->totalIncome += temp->data.amount;
+            else if (strcmp(temp->data.type, "Expense") == 0) out->totalExpense += temp->data.amount;
+        }
+    }
+    endCall(lock);
+    return out->count;
+}
@@ -0,0 +1,54 @@
+#ifndef LIBEXPENSE_H
+#define LIBEXPENSE_H
+
+#include "common.h"
+
+// In-process API over one account file, for callers such as the Python
+// frontend (ctypes/cffi) that would otherwise spawn the CLI per request.
+// Build every module except main.c as a shared library, e.g.
+//   gcc -shared -fPIC -O2 -pthread -o libexpense.so $(ls *.c | grep -v main.c)
+//
+// Each call takes the account lock like the CLI does and reloads the
+// account if another process changed it since the last call. Mutations
+// are made durable before returning. Calls print nothing: the backend's
+// status messages are switched off while a call runs, and failures come
+// back as -1 (or NULL from expenseSearch), including when the lock cannot
+// be taken.
+
+#define EXPENSE_ALL 0
+#define EXPENSE_BY_ID 1
+#define EXPENSE_BY_AMOUNT 2
+#define EXPENSE_BY_DESCRIPTION 3
+
+typedef struct ExpenseAccount ExpenseAccount;
+typedef struct ExpenseResult ExpenseResult;
+
+typedef struct {
+    int count;
+    double totalIncome;
+    double totalExpense;
+} ExpenseTotals;
+
+ExpenseAccount* expenseOpen(const char* filename);
+void expenseClose(ExpenseAccount* a);
+
+// Returns the new transaction's id, or -1 if it could not be saved.
+int expenseAdd(ExpenseAccount* a, int day, int month, int year, double amount,
+               const char* type, const char* category, const char* description);
+// Return 1 if something was deleted / undone, 0 if not, -1 on failure.
+int expenseDelete(ExpenseAccount* a, int id);
+int expenseUndo(ExpenseAccount* a);
+
+// Results refer to the account's own rows rather than copies, so they stay
+// valid only until the next call on the same account.
+ExpenseResult* expenseSearch(ExpenseAccount* a, int field, const char* value);
+int expenseResultCount(const ExpenseResult* r);
+const Transaction* expenseResultRow(const ExpenseResult* r, int index);
+int expenseResultFetch(const ExpenseResult* r, int offset, Transaction* buf, int max);
+void expenseResultFree(ExpenseResult* r);
+
+// category may be NULL for the whole account, archived rows included;
+// per-category totals cover the data file only.
+int expenseTotals(ExpenseAccount* a, const char* category, ExpenseTotals* out);
+
+#endif
@@ -1,7 +1,9 @@
 #include "linkedlist.h"
+#include "metrics.h"
 
 Node* createNode(Transaction data) {
     Node* newNode = (Node*)malloc(sizeof(Node));
+    metrics.nodesAllocated++;
     if (!newNode) {
         printf("Memory allocation failed!\n");
         return NULL;
@@ -63,26 +65,18 @@ Node* findNode(Node* head, int id) {
 }
 
 void displayList(Node* head) {
-    if (head == NULL) {
-        printf("No transactions found.\n");
-        return;
-    }
-    
-    printf("\n%-5s %-12s %-10s %-10s %-15s %-20s\n", "ID", "Date", "Amount", "Type", "Category", "Description");
-    printf("-------------------------------------------------------------------------------\n");
-    
+    OutputWriter w;
+    outInit(&w, stdout, FMT_TEXT, 0, 0);
+    writeList(head, &w);
+}
+
+void writeList(Node* head, OutputWriter* w) {
+    outBeginList(w, "transactions", ROW_TABLE);
     Node* temp = head;
-    while (temp != NULL) {
-        printf("%-5d %02d/%02d/%04d   %-10.2f %-10s %-15s %-20s\n", 
-               temp->data.id, 
-               temp->data.date.day, temp->data.date.month, temp->data.date.year, 
-               temp->data.amount, 
-               temp->data.type, 
-               temp->data.category, 
-               temp->data.description);
+    while (temp != NULL && outTransaction(w, &temp->data)) {
         temp = temp->next;
     }
-    printf("-------------------------------------------------------------------------------\n");
+    outEndList(w, "No transactions found.");
 }
 
 void freeList(Node* head) {
@@ -2,6 +2,7 @@
 #define LINKEDLIST_H
 
 #include "common.h"
+#include "output.h"
 
 typedef struct Node {
     Transaction data;
@@ -12,6 +13,7 @@ Node* createNode(Transaction data);
 void addNode(Node** head, Transaction data);
 int deleteNode(Node** head, int id);
 void displayList(Node* head);
+void writeList(Node* head, OutputWriter* w);
 void freeList(Node* head);
 Node* findNode(Node* head, int id);
 
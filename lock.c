@@ -0,0 +1,57 @@
+#include "lock.h"
+#include "file_ops.h"
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#endif
+
+int acquireLock(const char* filename, int mode) {
+    return acquireNamedLock(filename, "lock", mode);
+}
+
+int acquireNamedLock(const char* filename, const char* ext, int mode) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, ext);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+#ifdef _WIN32
+    OVERLAPPED ov = {0};
+    DWORD flags = mode == LOCK_WRITE ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+    if (!LockFileEx((HANDLE)_get_osfhandle(fd), flags, 0, 1, 0, &ov)) {
+        close(fd);
+        return -1;
+    }
+#else
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = mode == LOCK_WRITE ? F_WRLCK : F_RDLCK;
+    fl.l_whence = SEEK_SET;
+    if (fcntl(fd, F_SETLKW, &fl) != 0) {
+        close(fd);
+        return -1;
+    }
+#endif
+    return fd;
+}
+
+// Non-blocking: succeeds only when no other process holds the lock.
+int tryUpgradeLock(int handle) {
+    if (handle < 0) return 0;
+#ifdef _WIN32
+    return 0;
+#else
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    return fcntl(handle, F_SETLK, &fl) == 0;
+#endif
+}
+
+void releaseLock(int handle) {
+    if (handle >= 0) close(handle);
+}
@@ -0,0 +1,16 @@
+#ifndef LOCK_H
+#define LOCK_H
+
+#include "common.h"
+
+#define LOCK_READ 0
+#define LOCK_WRITE 1
+
+// Advisory lock on <file>.lock: any number of readers may hold LOCK_READ
+// together, LOCK_WRITE excludes everyone. Returns a handle, or -1.
+int acquireLock(const char* filename, int mode);
+int acquireNamedLock(const char* filename, const char* ext, int mode);
+int tryUpgradeLock(int handle);
+void releaseLock(int handle);
+
+#endif
@@ -5,28 +5,191 @@
 #include "bst.h"
 #include "file_ops.h"
 #include "utils.h"
+#include "appstate.h"
+#include "snapshot.h"
+#include "lock.h"
+#include "viewstore.h"
+#include "budget.h"
+#include "fuzzy.h"
+#include "commit.h"
+#include "stream.h"
+#include "cache.h"
+#include "commands.h"
+#include "versions.h"
+#include "sketch.h"
+#include "writebehind.h"
+#include "metrics.h"
+#include "archive.h"
+#include "sortkeys.h"
+#include "forecast.h"
+#include "csv.h"
+#include "output.h"
+#include <limits.h>
 
-int getNextId(Node* head) {
-    int maxId = 0;
-    Node* temp = head;
-    while (temp != NULL) {
-        if (temp->data.id > maxId) {
-            maxId = temp->data.id;
+typedef struct {
+    OutputFormat format;
+    int limit;
+    int after;
+    double afterKey;
+    int afterKeyed;
+    int order;
+    int dedupe;
+    int commitWindowMs;
+    int sync;
+    int stream;
+    int writeBehindMs;
+} GlobalOptions;
+
+// Strips the global --options from argv so positional arguments keep
+// their indices for the command handlers below.
+int parseGlobalOptions(int* argc, char* argv[], GlobalOptions* opts) {
+    opts->format = FMT_TEXT;
+    opts->limit = 0;
+    opts->after = 0;
+    opts->afterKey = 0;
+    opts->afterKeyed = 0;
+    opts->order = ORDER_STORED;
+    opts->dedupe = DEDUPE_OFF;
+    opts->commitWindowMs = DEFAULT_COMMIT_WINDOW_MS;
+    opts->sync = 1;
+    opts->stream = STREAM_AUTO;
+    opts->writeBehindMs = DEFAULT_WRITE_BEHIND_MS;
+
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        char* arg = argv[i];
+        if (strncmp(arg, "--format=", 9) == 0) {
+            if (!parseOutputFormat(arg + 9, &opts->format)) {
+                printf("Error: Unknown format '%s'. Supported: text, json, tsv, binary.\n", arg + 9);
+                return 0;
+            }
+        } else if (strncmp(arg, "--limit=", 8) == 0) {
+            opts->limit = atoi(arg + 8);
+        } else if (strncmp(arg, "--after=", 8) == 0) {
+            // ID, or KEY:ID as handed out by amount/date ordered listings.
+            const char* colon = strchr(arg + 8, ':');
+            opts->after = atoi(colon ? colon + 1 : arg + 8);
+            opts->afterKey = colon ? atof(arg + 8) : 0;
+            opts->afterKeyed = colon != NULL;
+        } else if (strncmp(arg, "--order=", 8) == 0) {
+            if (!parseOrder(arg + 8, &opts->order)) {
+                printf("Error: Unknown order '%s'. Supported: stored, id, amount, date.\n", arg + 8);
+                return 0;
+            }
+        } else if (strcmp(arg, "--dedupe") == 0 || strcmp(arg, "--dedupe=reject") == 0) {
+            opts->dedupe = DEDUPE_REJECT;
+        } else if (strcmp(arg, "--dedupe=flag") == 0) {
+            opts->dedupe = DEDUPE_FLAG;
+        } else if (strncmp(arg, "--commit-window=", 16) == 0) {
+            opts->commitWindowMs = atoi(arg + 16);
+        } else if (strcmp(arg, "--no-fsync") == 0) {
+            opts->sync = 0;
+        } else if (strcmp(arg, "--stream") == 0) {
+            opts->stream = STREAM_ON;
+        } else if (strcmp(arg, "--no-stream") == 0) {
+            opts->stream = STREAM_OFF;
+        } else if (strcmp(arg, "--stats") == 0) {
+            metrics.enabled = 1;
+        } else if (strncmp(arg, "--write-behind=", 15) == 0) {
+            opts->writeBehindMs = atoi(arg + 15);
+        } else {
+            argv[out++] = arg;
         }
-        temp = temp->next;
     }
-    return maxId + 1;
+    *argc = out;
+    argv[out] = NULL;
+    return 1;
+}
+
+typedef struct {
+    const char* name;
+    int needs;
+    int writes;
+    int cached;
+} CommandSpec;
+
+static const CommandSpec commandTable[] = {
+    {"add", NEED_TRANSACTIONS | NEED_UNDO | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"delete", NEED_TRANSACTIONS | NEED_UNDO | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"list", NEED_TRANSACTIONS, 0, 1},
+    {"sort_amount", NEED_VIEWS, 0, 1},
+    {"sort_date", NEED_VIEWS, 0, 1},
+    {"search", NEED_TRANSACTIONS, 0, 1},
+    {"analysis", NEED_TRANSACTIONS, 0, 1},
+    {"top", NEED_TRANSACTIONS, 0, 1},
+    {"bottom", NEED_TRANSACTIONS, 0, 1},
+    {"checkpoint", NEED_TRANSACTIONS, 1, 0},
+    {"budget", NEED_BUDGETS, 1, 0},
+    {"budget_remove", NEED_BUDGETS, 1, 0},
+    {"budgets", NEED_BUDGETS, 0, 1},
+    {"alerts", 0, 0, 0},
+    {"suggest", 0, 0, 0},
+    {"view_suggestions", 0, 0, 0},
+    {"delete_suggestion", 0, 0, 0},
+    {"reply_user", 0, 0, 0},
+    {"view_replies", 0, 0, 0},
+    {"undo", NEED_TRANSACTIONS | NEED_UNDO | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"recurring", NEED_TRANSACTIONS | NEED_RECURRING, 1, 0},
+    {"process_recurring", NEED_TRANSACTIONS | NEED_UNDO | NEED_RECURRING | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"view_recurring", NEED_RECURRING, 0, 1},
+    {"versions", 0, 0, 0},
+    {"as_of", 0, 0, 0},
+    {"stats", NEED_SKETCHES, 0, 1},
+    {"stats_merge", 0, 0, 0},
+    {"rollback", NEED_TRANSACTIONS | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"archive", NEED_TRANSACTIONS | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"range", NEED_TRANSACTIONS, 0, 1},
+    {"sort", NEED_TRANSACTIONS, 0, 1},
+    {"forecast", NEED_TRANSACTIONS | NEED_RECURRING, 0, 0},
+    {"import", NEED_TRANSACTIONS | NEED_VIEWS | NEED_BUDGETS | NEED_SKETCHES, 1, 0},
+    {"export", NEED_TRANSACTIONS, 0, 0},
+};
+
+const CommandSpec* findCommand(const char* command) {
+    for (size_t i = 0; i < sizeof(commandTable) / sizeof(commandTable[0]); i++) {
+        if (strcmp(commandTable[i].name, command) == 0) return &commandTable[i];
+    }
+    return NULL;
+}
+
+// Everything that can change a cached result: the command line, the
+// options shaping the output, for the shared recurring queue its contents
+// (other accounts can change it without bumping ours) and, for budgets,
+// the current month that recurring limits are reported against.
+void buildCacheKey(char* buf, size_t size, int argc, char* argv[], const GlobalOptions* opts, const CommandSpec* spec) {
+    size_t n = snprintf(buf, size, "%d %d %d %.2f %d", opts->format, opts->limit, opts->after, opts->afterKey, opts->order);
+    for (int i = 2; i < argc && n < size; i++) {
+        n += snprintf(buf + n, size - n, "\x1f%s", argv[i]);
+    }
+    if ((spec->needs & NEED_RECURRING) && n < size) {
+        n += snprintf(buf + n, size - n, "\x1f%llx", contentDigest("recurring.txt"));
+    }
+    if ((spec->needs & NEED_BUDGETS) && n < size) {
+        time_t now = time(NULL);
+        struct tm* tm = localtime(&now);
+        snprintf(buf + n, size - n, "\x1f%04d%02d", tm->tm_year + 1900, tm->tm_mon + 1);
+    }
 }
 
 void printUsage() {
-    printf("Usage: expense_tracker <filename> <command> [args...]\n");
+    printf("Usage: expense_tracker [--format=text|json|tsv|binary] [--limit=N] [--after=ID|KEY:ID] [--order=stored|id|amount|date] [--dedupe[=reject|flag]] [--commit-window=MS] [--no-fsync] [--stream|--no-stream] [--write-behind=MS] [--stats] <filename> <command> [args...]\n");
     printf("Commands:\n");
     printf("  add <day> <month> <year> <amount> <type> <category> <description>\n");
     printf("  delete <id>\n");
+    printf("  list\n");
     printf("  sort_amount\n");
     printf("  sort_date\n");
+    printf("  sort <key>[,<key>...]   keys: id, date, amount, type, category, description; '-' for descending\n");
     printf("  search <type> <value>\n");
+    printf("  search fuzzy <text> [max_distance]\n");
     printf("  analysis\n");
+    printf("  top <k> [expense|income] [category]\n");
+    printf("  bottom <k> [expense|income] [category]\n");
+    printf("  checkpoint\n");
+    printf("  budget <category> <limit> [<month> <year>]\n");
+    printf("  budget_remove <category> [<month> <year>]\n");
+    printf("  budgets\n");
+    printf("  alerts\n");
     printf("  suggest <username> <text>\n");
     printf("  view_suggestions\n");
     printf("  delete_suggestion <line_number>\n");
@@ -36,77 +199,274 @@ void printUsage() {
     printf("  recurring <day> <month> <year> <amount> <type> <category> <description>\n");
     printf("  process_recurring\n");
     printf("  view_recurring\n");
+    printf("  forecast <months>\n");
+    printf("  versions [count]\n");
+    printf("  as_of <version|YYYY-MM-DD[THH:MM[:SS]]> [list|analysis]\n");
+    printf("  rollback <version>\n");
+    printf("  stats [<month> <year>]\n");
+    printf("  stats_merge <other_file>... [--month=MM/YYYY]\n");
+    printf("  archive <day> <month> <year>\n");
+    printf("  range <YYYY-MM-DD> <YYYY-MM-DD> [list|analysis]\n");
+    printf("  import <file.csv|file.tsv> [field=Header|field=N,...]\n");
+    printf("  export <file.csv|file.tsv>\n");
+    printf("Archived transactions count towards analysis, range and export; other commands see the data file only.\n");
 }
 
-void rebuildBST(Node* head, BSTNode** bstRoot) {
-    freeBST(*bstRoot);
-    *bstRoot = NULL;
-    Node* temp = head;
-    while (temp != NULL) {
-        *bstRoot = insertBST(*bstRoot, temp->data);
-        temp = temp->next;
+// A plain number is a version; a date means the end of that day unless a
+// time is given.
+int resolveVersion(const char* filename, const char* arg, VersionRecord* rec) {
+    if (strchr(arg, '-') == NULL) return findVersion(filename, atol(arg), rec);
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int fields = sscanf(arg, "%d-%d-%d%*c%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                        &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (fields < 3) return 0;
+    if (fields == 3) {
+        tm.tm_hour = 23;
+        tm.tm_min = 59;
+        tm.tm_sec = 59;
     }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return findVersionAt(filename, (long)mktime(&tm), rec);
 }
 
-void cmdAdd(Node** head, StackNode** undoStack, BSTNode** bstRoot, char* filename, Transaction t) {
-    addNode(head, t);
-    push(undoStack, t, OP_ADD);
-    saveStack(*undoStack, "undo_stack.txt");
-    saveToFile(*head, filename);
-    *bstRoot = insertBST(*bstRoot, t);
-    printf("Transaction added successfully. ID: %d\n", t.id);
+// top/bottom <k> [expense|income] [category]. Returns 0 (after printing
+// an error) unless k is a positive integer.
+int parseTopArgs(int argc, char* argv[], int* k, const char** type, const char** category) {
+    char* end;
+    long value = strtol(argv[3], &end, 10);
+    if (end == argv[3] || *end != '\0' || value <= 0 || value > INT_MAX) {
+        printf("Error: k must be a positive integer.\n");
+        return 0;
+    }
+    *k = (int)value;
+    *type = NULL;
+    *category = NULL;
+    int arg = 4;
+    if (arg < argc && (strcmp(argv[arg], "expense") == 0 || strcmp(argv[arg], "income") == 0)) {
+        *type = argv[arg++];
+    }
+    if (arg < argc) *category = argv[arg];
+    return 1;
 }
 
-void cmdDelete(Node** head, StackNode** undoStack, BSTNode** bstRoot, char* filename, int id) {
-    Node* nodeToDelete = findNode(*head, id);
-    if (nodeToDelete) {
-        Transaction t = nodeToDelete->data;
-        if (deleteNode(head, id)) {
-            push(undoStack, t, OP_DELETE);
-            saveStack(*undoStack, "undo_stack.txt");
-            saveToFile(*head, filename);
-            rebuildBST(*head, bstRoot);
-            printf("Transaction %d deleted successfully.\n", id);
+typedef struct {
+    OutputWriter* out;
+    int id;
+    double amount;
+    const char* text;
+    int found;
+    int count;
+    double totalIncome;
+    double totalExpense;
+    Transaction* heap;
+    int heapCount;
+    int heapCapacity;
+    int k;
+    int largest;
+    const char* type;
+    const char* category;
+    int fromDate;
+    int toDate;
+    int totalsOnly;
+    RunSorter* sorter;
+} StreamQuery;
+
+static int visitList(const Transaction* t, void* ctx) {
+    return outTransaction(((StreamQuery*)ctx)->out, t);
+}
+
+static int visitId(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    if (t->id != q->id) return 1;
+    outTransaction(q->out, t);
+    return 0;
+}
+
+static int visitAmount(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    return t->amount == q->amount ? outTransaction(q->out, t) : 1;
+}
+
+static int visitDescription(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    return strstr(t->description, q->text) != NULL ? outTransaction(q->out, t) : 1;
+}
+
+static int visitTotals(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    q->count++;
+    if (strcmp(t->type, "Income") == 0) q->totalIncome += t->amount;
+    else if (strcmp(t->type, "Expense") == 0) q->totalExpense += t->amount;
+    return 1;
+}
+
+// The heap grows with the matching rows, so a k larger than the file
+// costs no more than the rows themselves.
+static int visitTopK(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    if (!matchesFilter(t, q->type, q->category)) return 1;
+    if (q->heapCount == q->heapCapacity && q->heapCapacity < q->k) {
+        int capacity = q->heapCapacity ? q->heapCapacity * 2 : 64;
+        if (capacity > q->k || capacity < q->heapCapacity) capacity = q->k;
+        Transaction* grown = (Transaction*)realloc(q->heap, sizeof(Transaction) * capacity);
+        if (!grown) {
+            q->found = -1;
+            return 0;
         }
+        q->heap = grown;
+        q->heapCapacity = capacity;
+    }
+    topKOffer(q->heap, &q->heapCount, q->k, q->largest, t);
+    return 1;
+}
+
+static int visitRange(const Transaction* t, void* ctx) {
+    StreamQuery* q = (StreamQuery*)ctx;
+    int key = dateKey(t->date);
+    if (key < q->fromDate || key > q->toDate) return 1;
+    return q->totalsOnly ? visitTotals(t, ctx) : runSorterAdd(t, q->sorter);
+}
+
+void writeSorted(RunSorter* sorter, OutputWriter* out) {
+    StreamQuery q;
+    memset(&q, 0, sizeof(q));
+    q.out = out;
+    outBeginList(out, "transactions", ROW_TABLE);
+    runSorterFinish(sorter, visitList, &q);
+    outEndList(out, "No transactions found.");
+}
+
+// sort <keys>: rows come from the loaded list, or straight from the file
+// when nothing is loaded, through a RunSorter so a large file is sorted in
+// spilled runs rather than copied into memory. The data file keeps its
+// order.
+void runSort(int argc, char* argv[], const char* filename, Node* head, int loaded, OutputWriter* out) {
+    SortSpec spec;
+    if (argc < 4 || !parseSortSpec(argv[3], &spec)) {
+        printf("Error: Usage: sort <key>[,<key>...] with keys id, date, amount, type, category, description.\n");
+        return;
+    }
+    RunSorter sorter;
+    runSorterInit(&sorter, &spec);
+    if (loaded) {
+        for (Node* temp = head; temp != NULL; temp = temp->next) runSorterAdd(&temp->data, &sorter);
     } else {
-        printf("Error: Transaction %d not found.\n", id);
+        streamTransactions(filename, runSorterAdd, &sorter);
     }
+    writeSorted(&sorter, out);
 }
 
-void cmdUndo(Node** head, StackNode** undoStack, BSTNode** bstRoot, char* filename) {
-    if (isStackEmpty(*undoStack)) {
-        printf("Nothing to undo.\n");
+// range <from> <to> [list|analysis], dates as YYYY-MM-DD. Data file rows
+// come from the loaded list, or straight from the file when nothing is
+// loaded; the archive is only read for segments overlapping the range.
+// Listed rows are put in date order by a RunSorter.
+void runRange(int argc, char* argv[], const char* filename, Node* head, int loaded, OutputWriter* out) {
+    Date from, to;
+    if (argc < 5 || sscanf(argv[3], "%d-%d-%d", &from.year, &from.month, &from.day) != 3 ||
+        sscanf(argv[4], "%d-%d-%d", &to.year, &to.month, &to.day) != 3) {
+        printf("Error: Usage: range <YYYY-MM-DD> <YYYY-MM-DD> [list|analysis]\n");
+        return;
+    }
+    SortSpec byDate;
+    RunSorter sorter;
+    parseSortSpec("date,id", &byDate);
+    runSorterInit(&sorter, &byDate);
+    StreamQuery q;
+    memset(&q, 0, sizeof(q));
+    q.fromDate = dateKey(from);
+    q.toDate = dateKey(to);
+    q.totalsOnly = argc >= 6 && strcmp(argv[5], "analysis") == 0;
+    q.sorter = &sorter;
+
+    if (loaded) {
+        for (Node* temp = head; temp != NULL; temp = temp->next) visitRange(&temp->data, &q);
     } else {
-        OperationType opType;
-        Transaction t = pop(undoStack, &opType);
-        
-        if (opType == OP_ADD) {
-            deleteNode(head, t.id);
-            printf("Undo: Removed transaction %d.\n", t.id);
-        } else if (opType == OP_DELETE) {
-            addNode(head, t);
-            printf("Undo: Restored transaction %d.\n", t.id);
-        }
-        saveToFile(*head, filename);
-        saveStack(*undoStack, "undo_stack.txt");
-        rebuildBST(*head, bstRoot);
+        streamTransactions(filename, visitRange, &q);
+    }
+
+    if (q.totalsOnly) {
+        ArchiveSummary archived;
+        archiveRangeTotals(filename, q.fromDate, q.toDate, &archived);
+        if (q.count + archived.count > 0) {
+            printFinancialSummary(q.totalIncome + archived.totalIncome, q.totalExpense + archived.totalExpense);
+        }
+        return;
     }
+    scanArchive(filename, q.fromDate, q.toDate, visitRange, &q);
+    writeSorted(&sorter, out);
 }
 
-void cmdProcessRecurring(Node** head, StackNode** undoStack, Queue* recurringQueue, BSTNode** bstRoot, char* filename) {
-    if (isQueueEmpty(recurringQueue)) {
-        printf("No recurring payments to process.\n");
+// Runs a read-only command in one pass over the data file without building
+// the list. Returns 0 if the command has no streaming form.
+int runStreaming(const char* command, int argc, char* argv[], const char* filename, int order, OutputWriter* out) {
+    StreamQuery q;
+    memset(&q, 0, sizeof(q));
+    q.out = out;
+
+    settleArchive(filename);
+    if (out->after > 0 && !streamHasId(filename, out->after)) out->cursorGone = 1;
+    if (strcmp(command, "list") == 0 && order == ORDER_STORED) {
+        outBeginList(out, "transactions", ROW_TABLE);
+        streamTransactions(filename, visitList, &q);
+        outEndList(out, "No transactions found.");
+    } else if (strcmp(command, "search") == 0 && argc >= 5 && strcmp(argv[3], "id") == 0) {
+        char notFound[64];
+        q.id = atoi(argv[4]);
+        sprintf(notFound, "Transaction with ID %d not found.", q.id);
+        outBeginList(out, "search", ROW_FOUND);
+        streamTransactions(filename, visitId, &q);
+        outEndList(out, notFound);
+    } else if (strcmp(command, "search") == 0 && argc >= 5 && strcmp(argv[3], "amount") == 0) {
+        q.amount = atof(argv[4]);
+        outBeginList(out, "search", ROW_PLAIN);
+        streamTransactions(filename, visitAmount, &q);
+        outEndList(out, NULL);
+    } else if (strcmp(command, "search") == 0 && argc >= 5 && strcmp(argv[3], "description") == 0) {
+        char notFound[MAX_DESC + 64];
+        q.text = argv[4];
+        snprintf(notFound, sizeof(notFound), "No transactions found matching '%s'.", q.text);
+        outBeginList(out, "search", ROW_FOUND);
+        streamTransactions(filename, visitDescription, &q);
+        outEndList(out, notFound);
+    } else if (strcmp(command, "analysis") == 0) {
+        ArchiveSummary archived;
+        streamTransactions(filename, visitTotals, &q);
+        readArchiveSummary(filename, &archived);
+        if (q.count + archived.count > 0) {
+            printFinancialSummary(q.totalIncome + archived.totalIncome, q.totalExpense + archived.totalExpense);
+        }
+    } else if (strcmp(command, "range") == 0) {
+        runRange(argc, argv, filename, NULL, 0, out);
+    } else if (strcmp(command, "sort") == 0) {
+        runSort(argc, argv, filename, NULL, 0, out);
+    } else if (strcmp(command, "export") == 0 && argc >= 4) {
+        long n = exportCsv(argv[3], filename, NULL);
+        if (n >= 0) printf("Exported %ld transaction(s) to %s.\n", n, argv[3]);
+    } else if ((strcmp(command, "top") == 0 || strcmp(command, "bottom") == 0) && argc >= 4) {
+        if (!parseTopArgs(argc, argv, &q.k, &q.type, &q.category)) return 1;
+        q.largest = strcmp(command, "top") == 0;
+        streamTransactions(filename, visitTopK, &q);
+        if (q.found < 0) {
+            printf("Error: Out of memory for the top %d rows.\n", q.k);
+            free(q.heap);
+            return 1;
+        }
+        topKFinish(q.heap, q.heapCount, q.largest);
+        outBeginList(out, command, ROW_TABLE);
+        for (int i = 0; i < q.heapCount && outTransaction(out, &q.heap[i]); i++);
+        outEndList(out, "No transactions found.");
+        free(q.heap);
     } else {
-        Transaction t = dequeue(recurringQueue);
-        t.id = getNextId(*head);
-        
-        cmdAdd(head, undoStack, bstRoot, filename, t);
-        saveQueue(recurringQueue, "recurring.txt");
-        printf("Processed recurring payment: %s - %.2f\n", t.description, t.amount);
+        return 0;
     }
+    return 1;
 }
 
-void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue, BSTNode** bstRoot, char* filename) {
+void interactiveMenu(AppState* s) {
     int choice;
     while (1) {
         printf("\n--- Expense Tracker Menu ---\n");
@@ -128,7 +488,6 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
         switch (choice) {
             case 1: {
                 Transaction t;
-                t.id = getNextId(*head);
                 printf("Enter Date (DD MM YYYY): ");
                 scanf("%d %d %d", &t.date.day, &t.date.month, &t.date.year);
                 printf("Enter Amount: ");
@@ -142,22 +501,35 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                 fgets(t.description, MAX_DESC, stdin);
                 t.description[strcspn(t.description, "\n")] = 0;
 
-                cmdAdd(head, undoStack, bstRoot, filename, t);
+                sessionBegin(s, LOCK_WRITE);
+                long before = s->generation;
+                t.id = getNextId(s);
+                cmdAdd(s, t);
+                sessionEnd(s, s->generation != before);
                 break;
             }
             case 2: {
                 int id;
                 printf("Enter ID to delete: ");
                 scanf("%d", &id);
-                cmdDelete(head, undoStack, bstRoot, filename, id);
+                sessionBegin(s, LOCK_WRITE);
+                long before = s->generation;
+                cmdDelete(s, id);
+                sessionEnd(s, s->generation != before);
                 break;
             }
             case 3:
-                displayList(*head);
+                sessionBegin(s, LOCK_READ);
+                displayList(s->head);
+                sessionEnd(s, 0);
                 break;
-            case 4:
-                cmdUndo(head, undoStack, bstRoot, filename);
+            case 4: {
+                sessionBegin(s, LOCK_WRITE);
+                long before = s->generation;
+                cmdUndo(s);
+                sessionEnd(s, s->generation != before);
                 break;
+            }
             case 5: {
                 int searchChoice;
                 printf("Search by: 1. Amount, 2. ID, 3. Description: ");
@@ -166,19 +538,28 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                     double amt;
                     printf("Enter Amount: ");
                     scanf("%lf", &amt);
-                    searchBST(*bstRoot, amt);
+                    sessionBegin(s, LOCK_READ);
+                    OutputWriter w;
+                    outInit(&w, stdout, FMT_TEXT, 0, 0);
+                    outBeginList(&w, "search", ROW_PLAIN);
+                    searchBST(s->bstRoot, amt, &w);
+                    outEndList(&w, NULL);
+                    sessionEnd(s, 0);
                 } else if (searchChoice == 2) {
                     int id;
                     printf("Enter ID: ");
                     scanf("%d", &id);
-                    Node* res = findNode(*head, id);
+                    sessionBegin(s, LOCK_READ);
+                    Node* res = findNode(s->head, id);
                     if (res) printf("Found: ID: %d, Amount: %.2f, Desc: %s\n", res->data.id, res->data.amount, res->data.description);
                     else printf("Not found.\n");
+                    sessionEnd(s, 0);
                 } else if (searchChoice == 3) {
                     char desc[MAX_DESC];
                     printf("Enter Description: ");
                     scanf("%s", desc);
-                    Node* temp = *head;
+                    sessionBegin(s, LOCK_READ);
+                    Node* temp = s->head;
                     int found = 0;
                     while (temp != NULL) {
                         if (strstr(temp->data.description, desc) != NULL) {
@@ -188,6 +569,7 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                         temp = temp->next;
                     }
                     if (!found) printf("No match.\n");
+                    sessionEnd(s, 0);
                 }
                 break;
             }
@@ -195,14 +577,19 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                 int sortChoice;
                 printf("Sort by: 1. Amount, 2. Date: ");
                 scanf("%d", &sortChoice);
-                if (sortChoice == 1) sortTransactionsByAmount(head);
-                else if (sortChoice == 2) sortTransactionsByDate(head);
-                saveToFile(*head, filename);
-                printf("Sorted.\n");
+                if (sortChoice == 1 || sortChoice == 2) {
+                    OutputWriter w;
+                    outInit(&w, stdout, FMT_TEXT, 0, 0);
+                    sessionBegin(s, LOCK_READ);
+                    writeOrdered(s, sortChoice == 1 ? ORDER_AMOUNT : ORDER_DATE, &w);
+                    sessionEnd(s, 0);
+                }
                 break;
             }
             case 7:
-                getCategoryTotals(*head);
+                sessionBegin(s, LOCK_READ);
+                getCategoryTotals(s->head);
+                sessionEnd(s, 0);
                 break;
             case 8: {
                 int rChoice;
@@ -210,7 +597,6 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                 scanf("%d", &rChoice);
                 if (rChoice == 1) {
                     Transaction t;
-                    t.id = getNextId(*head);
                     printf("Enter Date (DD MM YYYY): ");
                     scanf("%d %d %d", &t.date.day, &t.date.month, &t.date.year);
                     printf("Enter Amount: ");
@@ -224,13 +610,21 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
                     fgets(t.description, MAX_DESC, stdin);
                     t.description[strcspn(t.description, "\n")] = 0;
 
-                    enqueue(recurringQueue, t);
-                    saveQueue(recurringQueue, "recurring.txt");
+                    sessionBegin(s, LOCK_WRITE);
+                    t.id = getNextId(s);
+                    enqueue(s->recurringQueue, t);
+                    if (!deferSave(s, DIRTY_RECURRING)) saveQueue(s->recurringQueue, "recurring.txt");
+                    sessionEnd(s, 1);
                     printf("Scheduled.\n");
                 } else if (rChoice == 2) {
-                    displayQueue(recurringQueue);
+                    sessionBegin(s, LOCK_READ);
+                    displayQueue(s->recurringQueue);
+                    sessionEnd(s, 0);
                 } else if (rChoice == 3) {
-                    cmdProcessRecurring(head, undoStack, recurringQueue, bstRoot, filename);
+                    sessionBegin(s, LOCK_WRITE);
+                    int changed = !isQueueEmpty(s->recurringQueue);
+                    cmdProcessRecurring(s, DEDUPE_OFF);
+                    sessionEnd(s, changed);
                 }
                 break;
             }
@@ -244,55 +638,28 @@ void interactiveMenu(Node** head, StackNode** undoStack, Queue* recurringQueue,
     }
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        printUsage();
-        return 1;
-    }
-
-    Node* head = NULL;
-    BSTNode* bstRoot = NULL;
-    StackNode* undoStack = NULL;
-    Queue* recurringQueue = createQueue();
-    
-    char* filename = argv[1];
-    loadFromFile(&head, filename);
-    loadQueue(recurringQueue, "recurring.txt");
-    loadStack(&undoStack, "undo_stack.txt");
-
-    Node* temp = head;
-    while (temp != NULL) {
-        bstRoot = insertBST(bstRoot, temp->data);
-        temp = temp->next;
-    }
-
-    if (argc == 2) {
-        interactiveMenu(&head, &undoStack, recurringQueue, &bstRoot, filename);
-        freeList(head);
-        freeBST(bstRoot);
-        freeStack(undoStack);
-        freeQueue(recurringQueue);
-        return 0;
-    }
-
-    char* command = argv[2];
-
+// Runs one command against the loaded state and returns the exit status.
+// *changed is set by commands whose files the data generation does not
+// cover (budgets, recurring).
+static int runCommand(const char* command, int argc, char* argv[], AppState* state, const GlobalOptions* opts,
+                      OutputWriter* out, int* changed) {
     if (strcmp(command, "add") == 0) {
         if (argc < 10) {
             printf("Error: Missing arguments for add.\n");
             return 1;
         }
         Transaction t;
-        t.id = getNextId(head);
+        t.id = getNextId(state);
         t.date.day = atoi(argv[3]);
         t.date.month = atoi(argv[4]);
         t.date.year = atoi(argv[5]);
         t.amount = atof(argv[6]);
-        strncpy(t.type, argv[7], MAX_TYPE);
-        strncpy(t.category, argv[8], MAX_CAT);
-        strncpy(t.description, argv[9], MAX_DESC);
+        snprintf(t.type, sizeof(t.type), "%s", argv[7]);
+        snprintf(t.category, sizeof(t.category), "%s", argv[8]);
+        snprintf(t.description, sizeof(t.description), "%s", argv[9]);
 
-        cmdAdd(&head, &undoStack, &bstRoot, filename, t);
+        if (rejectDuplicate(state, &t, opts->dedupe)) return 1;
+        cmdAdd(state, t);
 
     } else if (strcmp(command, "delete") == 0) {
         if (argc < 4) {
@@ -300,17 +667,17 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         int id = atoi(argv[3]);
-        cmdDelete(&head, &undoStack, &bstRoot, filename, id);
+        cmdDelete(state, id);
+
+    } else if (strcmp(command, "list") == 0) {
+        if (opts->order != ORDER_STORED) ensureLoaded(state, NEED_VIEWS);
+        writeOrdered(state, opts->order, out);
 
     } else if (strcmp(command, "sort_amount") == 0) {
-        sortTransactionsByAmount(&head);
-        saveToFile(head, filename);
-        printf("Sorted by amount and saved.\n");
+        writeOrdered(state, ORDER_AMOUNT, out);
 
     } else if (strcmp(command, "sort_date") == 0) {
-        sortTransactionsByDate(&head);
-        saveToFile(head, filename);
-        printf("Sorted by date and saved.\n");
+        writeOrdered(state, ORDER_DATE, out);
 
     } else if (strcmp(command, "search") == 0) {
         if (argc < 5) {
@@ -321,33 +688,106 @@ int main(int argc, char* argv[]) {
         
         if (strcmp(searchType, "amount") == 0) {
             double amount = atof(argv[4]);
-            searchBST(bstRoot, amount);
+            outBeginList(out, "search", ROW_PLAIN);
+            ensureLoaded(state, NEED_INDEX);
+            searchBST(state->bstRoot, amount, out);
+            outEndList(out, NULL);
         } else if (strcmp(searchType, "id") == 0) {
             int id = atoi(argv[4]);
-            Node* res = findNode(head, id);
-            if (res) {
-                printf("Found: ID: %d, Amount: %.2f, Desc: %s\n", res->data.id, res->data.amount, res->data.description);
-            } else {
-                printf("Transaction with ID %d not found.\n", id);
-            }
+            char notFound[64];
+            sprintf(notFound, "Transaction with ID %d not found.", id);
+            Node* res = findNode(state->head, id);
+            outBeginList(out, "search", ROW_FOUND);
+            if (res) outTransaction(out, &res->data);
+            outEndList(out, notFound);
         } else if (strcmp(searchType, "description") == 0) {
             char* desc = argv[4];
-            Node* temp = head;
-            int found = 0;
+            char notFound[MAX_DESC + 64];
+            snprintf(notFound, sizeof(notFound), "No transactions found matching '%s'.", desc);
+            outBeginList(out, "search", ROW_FOUND);
+            Node* temp = state->head;
             while (temp != NULL) {
                 if (strstr(temp->data.description, desc) != NULL) {
-                    printf("Found: ID: %d, Amount: %.2f, Desc: %s\n", temp->data.id, temp->data.amount, temp->data.description);
-                    found = 1;
+                    if (!outTransaction(out, &temp->data)) break;
                 }
                 temp = temp->next;
             }
-            if (!found) printf("No transactions found matching '%s'.\n", desc);
+            outEndList(out, notFound);
+        } else if (strcmp(searchType, "fuzzy") == 0) {
+            int maxDist = argc >= 6 ? atoi(argv[5]) : (strlen(argv[4]) <= 4 ? 1 : 2);
+            FuzzyIndex index;
+            if (!loadFuzzyIndex(&index, state)) {
+                buildFuzzyIndex(&index, state->head);
+                saveFuzzyIndex(&index, state);
+            }
+            fuzzySearch(&index, argv[4], maxDist, out);
+            freeFuzzyIndex(&index);
         } else {
-            printf("Error: Unknown search type '%s'. Supported: amount, id, description.\n", searchType);
+            printf("Error: Unknown search type '%s'. Supported: amount, id, description, fuzzy.\n", searchType);
         }
 
     } else if (strcmp(command, "analysis") == 0) {
-        getCategoryTotals(head);
+        ArchiveSummary archived;
+        readArchiveSummary(state->filename, &archived);
+        if (state->count + archived.count > 0) {
+            printFinancialSummary(state->totalIncome + archived.totalIncome, state->totalExpense + archived.totalExpense);
+        }
+
+    } else if (strcmp(command, "top") == 0 || strcmp(command, "bottom") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: %s <k> [expense|income] [category]\n", command);
+            return 1;
+        }
+        int k;
+        const char* type;
+        const char* category;
+        if (!parseTopArgs(argc, argv, &k, &type, &category)) return 1;
+        if (k > state->count) k = state->count > 0 ? state->count : 1;
+        Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * k);
+        if (!rows) {
+            printf("Error: Out of memory for the top %d rows.\n", k);
+            return 1;
+        }
+        int n = selectTopK(state->head, k, strcmp(command, "top") == 0, type, category, rows);
+        outBeginList(out, command, ROW_TABLE);
+        for (int i = 0; i < n && outTransaction(out, &rows[i]); i++);
+        outEndList(out, "No transactions found.");
+        free(rows);
+
+    } else if (strcmp(command, "budget") == 0) {
+        if (argc < 5) {
+            printf("Error: Usage: budget <category> <limit> [<month> <year>]\n");
+            return 1;
+        }
+        int month = argc >= 7 ? atoi(argv[5]) : 0;
+        int year = argc >= 7 ? atoi(argv[6]) : 0;
+        setBudget(state, argv[3], atof(argv[4]), month, year);
+        *changed = 1;
+        printf("Budget for %s set to %.2f.\n", argv[3], atof(argv[4]));
+
+    } else if (strcmp(command, "budget_remove") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: budget_remove <category> [<month> <year>]\n");
+            return 1;
+        }
+        int month = argc >= 6 ? atoi(argv[4]) : 0;
+        int year = argc >= 6 ? atoi(argv[5]) : 0;
+        if (removeBudget(state, argv[3], month, year)) {
+            *changed = 1;
+            printf("Budget for %s removed.\n", argv[3]);
+        } else {
+            printf("Error: No budget for %s.\n", argv[3]);
+        }
+
+    } else if (strcmp(command, "budgets") == 0) {
+        displayBudgets(state);
+
+    } else if (strcmp(command, "alerts") == 0) {
+        displayAlerts(state->filename);
+
+    } else if (strcmp(command, "checkpoint") == 0) {
+        if (writeSnapshot(state)) printf("Checkpoint written at generation %ld.\n", state->generation);
+        else printf("Error: Could not write checkpoint.\n");
 
     } else if (strcmp(command, "suggest") == 0) {
         if (argc < 5) {
@@ -455,7 +895,7 @@ int main(int argc, char* argv[]) {
         }
 
     } else if (strcmp(command, "undo") == 0) {
-        cmdUndo(&head, &undoStack, &bstRoot, filename);
+        cmdUndo(state);
 
     } else if (strcmp(command, "recurring") == 0) {
         if (argc < 10) {
@@ -463,35 +903,264 @@ int main(int argc, char* argv[]) {
             return 1;
         }
         Transaction t;
-        t.id = getNextId(head);
+        t.id = getNextId(state);
         t.date.day = atoi(argv[3]);
         t.date.month = atoi(argv[4]);
         t.date.year = atoi(argv[5]);
         t.amount = atof(argv[6]);
-        strncpy(t.type, argv[7], MAX_TYPE);
-        strncpy(t.category, argv[8], MAX_CAT);
-        strncpy(t.description, argv[9], MAX_DESC);
+        snprintf(t.type, sizeof(t.type), "%s", argv[7]);
+        snprintf(t.category, sizeof(t.category), "%s", argv[8]);
+        snprintf(t.description, sizeof(t.description), "%s", argv[9]);
 
-        enqueue(recurringQueue, t);
-        saveQueue(recurringQueue, "recurring.txt");
+        enqueue(state->recurringQueue, t);
+        saveQueue(state->recurringQueue, "recurring.txt");
+        *changed = 1;
         printf("Recurring payment scheduled.\n");
 
     } else if (strcmp(command, "process_recurring") == 0) {
-        cmdProcessRecurring(&head, &undoStack, recurringQueue, &bstRoot, filename);
+        *changed = !isQueueEmpty(state->recurringQueue);
+        cmdProcessRecurring(state, opts->dedupe);
 
     } else if (strcmp(command, "view_recurring") == 0) {
-        displayQueue(recurringQueue);
+        writeQueue(state->recurringQueue, out);
+
+    } else if (strcmp(command, "import") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: import <file.csv|file.tsv> [field=Header|field=N,...]\n");
+            return 1;
+        }
+        Transaction* rows;
+        int rejected;
+        int n = importCsv(argv[3], argc >= 5 ? argv[4] : NULL, &rows, &rejected);
+        if (n < 0) return 1;
+        int nextId = getNextId(state), kept = 0;
+        FingerprintIndex accepted;
+        initFingerprints(&accepted, n);
+        for (int i = 0; i < n; i++) {
+            if (rejectBatchDuplicate(state, &accepted, &rows[i], opts->dedupe)) {
+                rejected++;
+                continue;
+            }
+            rows[kept] = rows[i];
+            rows[kept++].id = nextId++;
+        }
+        freeFingerprints(&accepted);
+        cmdImport(state, rows, kept);
+        printf("Imported %d transaction(s), rejected %d.\n", kept, rejected);
+        free(rows);
+
+    } else if (strcmp(command, "export") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: export <file.csv|file.tsv>\n");
+            return 1;
+        }
+        long n = exportCsv(argv[3], state->filename, state->head);
+        if (n >= 0) printf("Exported %ld transaction(s) to %s.\n", n, argv[3]);
+
+    } else if (strcmp(command, "forecast") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: forecast <months>\n");
+            return 1;
+        }
+        displayForecast(state, atoi(argv[3]));
+
+    } else if (strcmp(command, "versions") == 0) {
+        displayVersions(state->filename, argc >= 4 ? atoi(argv[3]) : 20);
+
+    } else if (strcmp(command, "as_of") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: as_of <version|YYYY-MM-DD[THH:MM[:SS]]> [list|analysis]\n");
+            return 1;
+        }
+        VersionRecord rec;
+        if (!resolveVersion(state->filename, argv[3], &rec)) {
+            printf("Error: No version matches '%s'.\n", argv[3]);
+            return 1;
+        }
+        printf("As of version %ld:\n", rec.version);
+        if (argc >= 5 && strcmp(argv[4], "analysis") == 0) {
+            if (rec.count > 0) printFinancialSummary(rec.totalIncome, rec.totalExpense);
+        } else {
+            Transaction* rows;
+            int n = versionRows(state->filename, &rec, &rows);
+            outBeginList(out, "transactions", ROW_TABLE);
+            for (int i = 0; i < n && outTransaction(out, &rows[i]); i++);
+            outEndList(out, "No transactions found.");
+            free(rows);
+        }
+
+    } else if (strcmp(command, "stats") == 0) {
+        SketchBook* merged = createSketchBook();
+        mergeSketchBook(merged, state->sketches, argc >= 5 ? atoi(argv[4]) * 100 + atoi(argv[3]) : 0);
+        displayStats(merged);
+        freeSketchBook(merged);
+
+    } else if (strcmp(command, "stats_merge") == 0) {
+        // Admin view: the same statistics over several accounts at once.
+        int period = 0;
+        SketchBook* merged = createSketchBook();
+        for (int i = 2; i < argc; i++) {
+            int month, year;
+            if (sscanf(argv[i], "--month=%d/%d", &month, &year) == 2) period = year * 100 + month;
+        }
+        for (int i = 1; i < argc; i++) {
+            if (i == 2 || strncmp(argv[i], "--", 2) == 0) continue;
+            AppState account;
+            initAppState(&account, argv[i]);
+            int accountLock = acquireLock(account.filename, LOCK_READ);
+            ensureLoaded(&account, NEED_SKETCHES);
+            mergeSketchBook(merged, account.sketches, period);
+            releaseLock(accountLock);
+            freeAppState(&account);
+        }
+        displayStats(merged);
+        freeSketchBook(merged);
+
+    } else if (strcmp(command, "rollback") == 0) {
+        if (argc < 4) {
+            printf("Error: Usage: rollback <version>\n");
+            return 1;
+        }
+        cmdRollback(state, atol(argv[3]));
+
+    } else if (strcmp(command, "archive") == 0) {
+        if (argc < 6) {
+            printf("Error: Usage: archive <day> <month> <year>\n");
+            return 1;
+        }
+        Date cutoff;
+        cutoff.day = atoi(argv[3]);
+        cutoff.month = atoi(argv[4]);
+        cutoff.year = atoi(argv[5]);
+        cmdArchive(state, cutoff);
+
+    } else if (strcmp(command, "range") == 0) {
+        runRange(argc, argv, state->filename, state->head, 1, out);
+
+    } else if (strcmp(command, "sort") == 0) {
+        runSort(argc, argv, state->filename, state->head, 1, out);
 
     } else {
         printf("Unknown command: %s\n", command);
         printUsage();
         return 1;
     }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    double startMs = monotonicMs();
+    GlobalOptions opts;
+    if (!parseGlobalOptions(&argc, argv, &opts)) {
+        return 1;
+    }
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    setSyncOnSave(opts.sync);
 
-    freeList(head);
-    freeBST(bstRoot);
-    freeStack(undoStack);
-    freeQueue(recurringQueue);
+    OutputWriter* out = (OutputWriter*)malloc(sizeof(OutputWriter));
+    FILE* sink = (opts.format == FMT_TEXT || argc == 2) ? stdout : openStructuredSink();
+    outInit(out, sink, opts.format, opts.limit, opts.after);
+    if (opts.afterKeyed) outSetCursorKey(out, opts.afterKey);
 
-    return 0;
+    AppState state;
+    initAppState(&state, argv[1]);
+
+    // The session takes the account lock per command (see sessionBegin), so
+    // an idle menu does not hold off other readers and writers.
+    if (argc == 2) {
+        startWriteBehind(&state, opts.writeBehindMs);
+        interactiveMenu(&state);
+        stopWriteBehind(&state);
+        metricsReport("interactive", monotonicMs() - startMs, treeDepth(state.bstRoot));
+        free(out);
+        freeAppState(&state);
+        return 0;
+    }
+
+    char* command = argv[2];
+    const CommandSpec* spec = findCommand(command);
+    int lock = -1;
+    int served = 0;
+    int streamed = 0;
+    int capturing = 0;
+    char cacheKey[1024];
+    long dataGen = 0;
+    if (spec && spec->needs) {
+        lock = acquireLock(state.filename, spec->writes ? LOCK_WRITE : LOCK_READ);
+        if (spec->cached && !spec->writes) {
+            buildCacheKey(cacheKey, sizeof(cacheKey), argc, argv, &opts, spec);
+            dataGen = dataGeneration(state.filename);
+            served = cacheLookup(state.filename, cacheKey, dataGen, out->sink);
+            if (!served) capturing = beginCapture(out->sink);
+        }
+        double streamStart = metricsStart();
+        streamed = !served && !spec->writes && shouldStream(state.filename, opts.stream) &&
+                   runStreaming(command, argc, argv, state.filename, opts.order, out);
+        if (streamed) metricsStop(PHASE_COMMAND, streamStart);
+        if (!served && !streamed) {
+            ensureLoaded(&state, spec->needs);
+            if (opts.after > 0 && isLoaded(&state, NEED_TRANSACTIONS) && !findNode(state.head, opts.after)) {
+                out->cursorGone = 1;
+            }
+        }
+    }
+    long startGeneration = state.generation;
+    int changed = 0;
+    int status = 0;
+    double commandStart = metricsStart();
+
+    if (served || streamed) {
+        // Answered from the result cache or in a single pass over the file;
+        // nothing was loaded.
+    } else {
+        status = runCommand(command, argc, argv, &state, &opts, out, &changed);
+    }
+    if (!served) outStatus(out, command, status);
+
+    metricsStop(PHASE_COMMAND, commandStart);
+
+    // Failed commands are not cached; their output is still shown.
+    if (capturing) {
+        size_t len;
+        outFlush(out);
+        char* result = endCapture(&len);
+        if (result && status == 0) cacheStore(state.filename, cacheKey, dataGen, result, len);
+        free(result);
+    }
+
+    // Cached reads stay valid unless the command really changed something.
+    if (spec && spec->writes && (changed || state.generation > startGeneration)) {
+        bumpDataGeneration(state.filename);
+    }
+
+    // Readers only checkpoint when they can briefly become the sole holder.
+    if (isLoaded(&state, NEED_TRANSACTIONS) &&
+        (!state.fromSnapshot || state.journalLength >= CHECKPOINT_INTERVAL) &&
+        (spec->writes || tryUpgradeLock(lock))) {
+        writeSnapshot(&state);
+    }
+    releaseLock(lock);
+
+    if (opts.sync && isLoaded(&state, NEED_TRANSACTIONS) && state.generation > startGeneration) {
+        CommitResult commit;
+        double commitStart = metricsStart();
+        int committed = durableCommit(&state, opts.commitWindowMs, &commit);
+        metricsStop(PHASE_COMMIT, commitStart);
+        if (committed) {
+            fprintf(stderr, "Committed generation %ld in %.2f ms (%s, %d change(s) in group).\n",
+                   commit.generation, commit.latencyMs,
+                   commit.synced ? "fsync leader" : "joined group", commit.batched);
+        } else {
+            fprintf(stderr, "Error: Could not make generation %ld durable.\n", commit.generation);
+        }
+    }
+
+    outFlush(out);
+    metricsReport(command, monotonicMs() - startMs, treeDepth(state.bstRoot));
+    free(out);
+    freeAppState(&state);
+    return status;
 }
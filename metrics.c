@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime
+#include "metrics.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+Metrics metrics;
+
+#ifndef _WIN32
+// The write-behind worker saves alongside the main thread.
+static pthread_mutex_t saveMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static const char* phaseNames[PHASE_COUNT] = {"load", "index", "command", "save", "commit"};
+
+double monotonicMs(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart * 1000.0 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+#endif
+}
+
+double metricsStart(void) {
+    return metrics.enabled ? monotonicMs() : 0;
+}
+
+void metricsStop(int phase, double start) {
+    if (metrics.enabled) metrics.phaseMs[phase] += monotonicMs() - start;
+}
+
+void metricsSave(long bytes, double start) {
+#ifndef _WIN32
+    pthread_mutex_lock(&saveMutex);
+#endif
+    metrics.saves++;
+    metrics.bytesWritten += bytes;
+    metricsStop(PHASE_SAVE, start);
+#ifndef _WIN32
+    pthread_mutex_unlock(&saveMutex);
+#endif
+}
+
+// One JSON object on stderr, so it never mixes with command output.
+void metricsReport(const char* command, double totalMs, int treeDepth) {
+    if (!metrics.enabled) return;
+    fprintf(stderr, "{\"stats\":{\"command\":\"%s\",\"total_ms\":%.3f", command, totalMs);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stderr, ",\"%s_ms\":%.3f", phaseNames[i], metrics.phaseMs[i]);
+    }
+    fprintf(stderr, ",\"rows_parsed\":%ld,\"rows_restored\":%ld,\"nodes_allocated\":%ld,"
+                    "\"saves\":%d,\"bytes_written\":%ld,\"tree_depth\":%d}}\n",
+            metrics.rowsParsed, metrics.rowsRestored, metrics.nodesAllocated,
+            metrics.saves, metrics.bytesWritten, treeDepth);
+}
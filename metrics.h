@@ -0,0 +1,35 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+#define PHASE_LOAD 0
+#define PHASE_INDEX 1
+#define PHASE_COMMAND 2
+#define PHASE_SAVE 3
+#define PHASE_COMMIT 4
+#define PHASE_COUNT 5
+
+// Counters and phase timers for --stats. Counters are always kept (plain
+// increments); clocks are only read when metrics.enabled is set. Saves are
+// timed from openForReplace() to commitReplace(). A whole interactive
+// session is reported as one aggregate line.
+typedef struct {
+    int enabled;
+    double phaseMs[PHASE_COUNT];
+    long rowsParsed;
+    long rowsRestored;
+    long nodesAllocated;
+    long bytesWritten;
+    int saves;
+} Metrics;
+
+extern Metrics metrics;
+
+double monotonicMs(void);
+double metricsStart(void);
+void metricsStop(int phase, double start);
+void metricsSave(long bytes, double start);
+void metricsReport(const char* command, double totalMs, int treeDepth);
+
+#endif
@@ -0,0 +1,321 @@
+#define _POSIX_C_SOURCE 200809L  // fileno, fdopen, dup
+#include "output.h"
+#include "views.h"
+#include "cache.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#define TABLE_RULE "-------------------------------------------------------------------------------\n"
+#define QUEUE_RULE "----------------------------------------------------------\n"
+
+int parseOutputFormat(const char* name, OutputFormat* format) {
+    if (strcmp(name, "text") == 0) *format = FMT_TEXT;
+    else if (strcmp(name, "json") == 0) *format = FMT_JSON;
+    else if (strcmp(name, "tsv") == 0) *format = FMT_TSV;
+    else if (strcmp(name, "binary") == 0) *format = FMT_BINARY;
+    else return 0;
+    return 1;
+}
+
+// Structured output owns the real stdout; everything else printed with
+// printf (load/save messages, status lines) is moved to stderr so it can
+// never corrupt the machine-readable stream.
+FILE* openStructuredSink(void) {
+    fflush(stdout);
+    int fd = dup(fileno(stdout));
+    if (fd < 0) return stdout;
+    dup2(fileno(stderr), fileno(stdout));
+#ifdef _WIN32
+    _setmode(fd, _O_BINARY);
+#endif
+    FILE* sink = fdopen(fd, "wb");
+    return sink ? sink : stdout;
+}
+
+void outFlush(OutputWriter* w) {
+    if (w->len > 0) {
+        fwrite(w->buf, 1, w->len, w->sink);
+        w->len = 0;
+    }
+    fflush(w->sink);
+}
+
+static void outWrite(OutputWriter* w, const void* data, size_t n) {
+    if (w->len + n > OUT_BUF_SIZE) {
+        fwrite(w->buf, 1, w->len, w->sink);
+        w->len = 0;
+        checkCapture();
+        if (n > OUT_BUF_SIZE) {
+            fwrite(data, 1, n, w->sink);
+            return;
+        }
+    }
+    memcpy(w->buf + w->len, data, n);
+    w->len += n;
+}
+
+static void outPrintf(OutputWriter* w, const char* fmt, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+    outWrite(w, line, (size_t)n);
+}
+
+static void outJsonString(OutputWriter* w, const char* s) {
+    outWrite(w, "\"", 1);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            outWrite(w, esc, 2);
+        } else if (c < 0x20) {
+            outPrintf(w, "\\u%04x", c);
+        } else {
+            outWrite(w, s, 1);
+        }
+    }
+    outWrite(w, "\"", 1);
+}
+
+static void outTsvField(OutputWriter* w, const char* s) {
+    for (; *s; s++) {
+        char c = *s;
+        if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+        outWrite(w, &c, 1);
+    }
+}
+
+static void outBinInt(OutputWriter* w, int value) {
+    int32_t v = (int32_t)value;
+    outWrite(w, &v, sizeof(v));
+}
+
+static void outBinString(OutputWriter* w, const char* s) {
+    size_t n = strlen(s);
+    if (n > 255) n = 255;
+    unsigned char len = (unsigned char)n;
+    outWrite(w, &len, 1);
+    outWrite(w, s, n);
+}
+
+void outInit(OutputWriter* w, FILE* sink, OutputFormat format, int limit, int after) {
+    w->sink = sink;
+    w->format = format;
+    w->style = ROW_TABLE;
+    w->order = ORDER_STORED;
+    w->limit = limit;
+    w->after = after;
+    w->afterKey = 0;
+    w->keyed = 0;
+    w->skipping = after > 0;
+    w->cursorGone = 0;
+    w->emitted = 0;
+    w->lastId = 0;
+    w->lastKey = 0;
+    w->hasMore = 0;
+    w->lists = 0;
+    w->len = 0;
+}
+
+// The key half of a "key:id" cursor.
+void outSetCursorKey(OutputWriter* w, double key) {
+    w->afterKey = key;
+    w->keyed = 1;
+}
+
+static int keyedOrder(const OutputWriter* w) {
+    return w->order == ORDER_AMOUNT || w->order == ORDER_DATE;
+}
+
+void outBeginList(OutputWriter* w, const char* name, RowStyle style) {
+    w->style = style;
+    w->skipping = w->after > 0;
+    w->emitted = 0;
+    w->lastId = 0;
+    w->hasMore = 0;
+    w->lists++;
+
+    switch (w->format) {
+        case FMT_JSON:
+            outWrite(w, "{\"list\":", 8);
+            outJsonString(w, name);
+            outWrite(w, ",\"items\":[", 10);
+            break;
+        case FMT_TSV:
+            outPrintf(w, "id\tday\tmonth\tyear\tamount\ttype\tcategory\tdescription\n");
+            break;
+        case FMT_BINARY:
+            outWrite(w, "EXPB", 4);
+            outBinInt(w, 1);
+            break;
+        case FMT_TEXT:
+            break;
+    }
+}
+
+static void outTextHeader(OutputWriter* w) {
+    if (w->style == ROW_TABLE) {
+        outPrintf(w, "\n%-5s %-12s %-10s %-10s %-15s %-20s\n", "ID", "Date", "Amount", "Type", "Category", "Description");
+        outPrintf(w, TABLE_RULE);
+    } else if (w->style == ROW_RECURRING) {
+        outPrintf(w, "\n--- Upcoming Recurring Payments ---\n");
+        outPrintf(w, "%-12s %-10s %-15s %-20s\n", "Date", "Amount", "Category", "Description");
+        outPrintf(w, QUEUE_RULE);
+    }
+}
+
+static void outTextRow(OutputWriter* w, const Transaction* t) {
+    switch (w->style) {
+        case ROW_TABLE:
+        case ROW_PLAIN:
+            outPrintf(w, "%-5d %02d/%02d/%04d   %-10.2f %-10s %-15s %-20s\n",
+                      t->id,
+                      t->date.day, t->date.month, t->date.year,
+                      t->amount,
+                      t->type,
+                      t->category,
+                      t->description);
+            break;
+        case ROW_FOUND:
+            outPrintf(w, "Found: ID: %d, Amount: %.2f, Desc: %s\n", t->id, t->amount, t->description);
+            break;
+        case ROW_RECURRING:
+            outPrintf(w, "%02d/%02d/%04d   %-10.2f %-15s %-20s\n",
+                      t->date.day, t->date.month, t->date.year,
+                      t->amount,
+                      t->category,
+                      t->description);
+            break;
+    }
+}
+
+// Returns 0 once the page is full so callers can stop iterating early.
+int outTransaction(OutputWriter* w, const Transaction* t) {
+    if (w->skipping) {
+        if (w->keyed && keyedOrder(w)) {
+            double key = viewKey(t, w->order);
+            if (key < w->afterKey || (key == w->afterKey && t->id <= w->after)) return 1;
+            w->skipping = 0;
+        } else if (!w->cursorGone) {
+            if (t->id == w->after) w->skipping = 0;
+            return 1;
+        } else {
+            if (t->id <= w->after) return 1;
+            w->skipping = 0;
+        }
+    }
+    if (w->limit > 0 && w->emitted >= w->limit) {
+        w->hasMore = 1;
+        return 0;
+    }
+
+    switch (w->format) {
+        case FMT_TEXT:
+            if (w->emitted == 0) outTextHeader(w);
+            outTextRow(w, t);
+            break;
+        case FMT_JSON:
+            if (w->emitted > 0) outWrite(w, ",", 1);
+            outPrintf(w, "{\"id\":%d,\"day\":%d,\"month\":%d,\"year\":%d,\"amount\":%.2f,\"type\":",
+                      t->id, t->date.day, t->date.month, t->date.year, t->amount);
+            outJsonString(w, t->type);
+            outWrite(w, ",\"category\":", 12);
+            outJsonString(w, t->category);
+            outWrite(w, ",\"description\":", 15);
+            outJsonString(w, t->description);
+            outWrite(w, "}", 1);
+            break;
+        case FMT_TSV:
+            outPrintf(w, "%d\t%d\t%d\t%d\t%.2f\t", t->id, t->date.day, t->date.month, t->date.year, t->amount);
+            outTsvField(w, t->type);
+            outWrite(w, "\t", 1);
+            outTsvField(w, t->category);
+            outWrite(w, "\t", 1);
+            outTsvField(w, t->description);
+            outWrite(w, "\n", 1);
+            break;
+        case FMT_BINARY:
+            outWrite(w, "R", 1);
+            outBinInt(w, t->id);
+            outBinInt(w, t->date.day);
+            outBinInt(w, t->date.month);
+            outBinInt(w, t->date.year);
+            outWrite(w, &t->amount, sizeof(double));
+            outBinString(w, t->type);
+            outBinString(w, t->category);
+            outBinString(w, t->description);
+            break;
+    }
+
+    w->emitted++;
+    w->lastId = t->id;
+    if (keyedOrder(w)) w->lastKey = viewKey(t, w->order);
+    return 1;
+}
+
+void outEndList(OutputWriter* w, const char* emptyMsg) {
+    int next = w->hasMore ? w->lastId : 0;
+    char cursor[64];
+    if (w->order == ORDER_AMOUNT) snprintf(cursor, sizeof(cursor), "%.2f:%d", w->lastKey, next);
+    else if (w->order == ORDER_DATE) snprintf(cursor, sizeof(cursor), "%.0f:%d", w->lastKey, next);
+    else snprintf(cursor, sizeof(cursor), "%d", next);
+
+    switch (w->format) {
+        case FMT_TEXT:
+            if (w->emitted == 0) {
+                if (emptyMsg) outPrintf(w, "%s\n", emptyMsg);
+            } else if (w->style == ROW_TABLE) {
+                outPrintf(w, TABLE_RULE);
+            } else if (w->style == ROW_RECURRING) {
+                outPrintf(w, QUEUE_RULE);
+            }
+            if (next) outPrintf(w, "More results: --after=%s\n", cursor);
+            break;
+        case FMT_JSON:
+            if (next && keyedOrder(w)) outPrintf(w, "],\"count\":%d,\"next_after\":\"%s\"}\n", w->emitted, cursor);
+            else if (next) outPrintf(w, "],\"count\":%d,\"next_after\":%d}\n", w->emitted, next);
+            else outPrintf(w, "],\"count\":%d,\"next_after\":null}\n", w->emitted);
+            break;
+        case FMT_TSV:
+            if (next) outPrintf(w, "#next_after\t%s\n", cursor);
+            break;
+        case FMT_BINARY:
+            outWrite(w, "E", 1);
+            outBinInt(w, w->emitted);
+            outBinInt(w, next);
+            if (keyedOrder(w)) outWrite(w, &w->lastKey, sizeof(double));
+            break;
+    }
+    outFlush(w);
+}
+
+void outStatus(OutputWriter* w, const char* command, int status) {
+    if (w->lists > 0) return;
+    switch (w->format) {
+        case FMT_JSON:
+            outWrite(w, "{\"command\":", 11);
+            outJsonString(w, command);
+            outPrintf(w, ",\"status\":\"%s\"}\n", status == 0 ? "ok" : "error");
+            break;
+        case FMT_TSV:
+            outPrintf(w, "command\tstatus\n%s\t%s\n", command, status == 0 ? "ok" : "error");
+            break;
+        case FMT_BINARY:
+            outWrite(w, "EXPS", 4);
+            outBinString(w, command);
+            outBinInt(w, status);
+            break;
+        case FMT_TEXT:
+            return;
+    }
+    outFlush(w);
+}
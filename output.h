@@ -0,0 +1,64 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "common.h"
+
+#define OUT_BUF_SIZE 65536
+
+typedef enum {
+    FMT_TEXT,
+    FMT_JSON,
+    FMT_TSV,
+    FMT_BINARY
+} OutputFormat;
+
+typedef enum {
+    ROW_TABLE,      // displayList style table with header and footer
+    ROW_PLAIN,      // table rows without header (amount search)
+    ROW_FOUND,      // "Found: ..." lines (id / description search)
+    ROW_RECURRING   // displayQueue style table
+} RowStyle;
+
+// Buffered result writer shared by every listing/search command.
+// Rows are paginated with a cursor: rows are skipped up to and including
+// the one whose id equals 'after', then at most 'limit' rows are written.
+// If the cursor row has since been deleted the caller sets 'cursorGone',
+// and paging resumes at the first row with a larger id instead. Listings
+// in amount or date order (see writeOrdered) hand out "key:id" cursors
+// and resume after that (key, id), whether or not the row still exists.
+typedef struct {
+    FILE* sink;
+    OutputFormat format;
+    RowStyle style;
+    int order;
+    int limit;
+    int after;
+    double afterKey;
+    int keyed;
+    int skipping;
+    int cursorGone;
+    int emitted;
+    int lastId;
+    double lastKey;
+    int hasMore;
+    int lists;
+    size_t len;
+    char buf[OUT_BUF_SIZE];
+} OutputWriter;
+
+int parseOutputFormat(const char* name, OutputFormat* format);
+FILE* openStructuredSink(void);
+
+void outInit(OutputWriter* w, FILE* sink, OutputFormat format, int limit, int after);
+void outSetCursorKey(OutputWriter* w, double key);
+void outBeginList(OutputWriter* w, const char* name, RowStyle style);
+int outTransaction(OutputWriter* w, const Transaction* t);
+void outEndList(OutputWriter* w, const char* emptyMsg);
+void outFlush(OutputWriter* w);
+
+// With a structured format every other message goes to stderr, so a
+// command that wrote no list reports its exit status as a one-record
+// result instead of leaving stdout empty. No-op for text output.
+void outStatus(OutputWriter* w, const char* command, int status);
+
+#endif
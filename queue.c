@@ -1,4 +1,6 @@
 #include "queue.h"
+#include "file_ops.h"
+#include "metrics.h"
 
 Queue* createQueue() {
     Queue* q = (Queue*)malloc(sizeof(Queue));
@@ -8,6 +10,7 @@ Queue* createQueue() {
 
 void enqueue(Queue* q, Transaction data) {
     QueueNode* temp = (QueueNode*)malloc(sizeof(QueueNode));
+    metrics.nodesAllocated++;
     temp->data = data;
     temp->next = NULL;
 
@@ -43,25 +46,18 @@ int isQueueEmpty(Queue* q) {
 }
 
 void displayQueue(Queue* q) {
-    if (isQueueEmpty(q)) {
-        printf("No upcoming recurring payments.\n");
-        return;
-    }
-
-    printf("\n--- Upcoming Recurring Payments ---\n");
-    printf("%-12s %-10s %-15s %-20s\n", "Date", "Amount", "Category", "Description");
-    printf("----------------------------------------------------------\n");
+    OutputWriter w;
+    outInit(&w, stdout, FMT_TEXT, 0, 0);
+    writeQueue(q, &w);
+}
 
+void writeQueue(Queue* q, OutputWriter* w) {
+    outBeginList(w, "recurring", ROW_RECURRING);
     QueueNode* temp = q->front;
-    while (temp != NULL) {
-        printf("%02d/%02d/%04d   %-10.2f %-15s %-20s\n", 
-               temp->data.date.day, temp->data.date.month, temp->data.date.year, 
-               temp->data.amount, 
-               temp->data.category, 
-               temp->data.description);
+    while (temp != NULL && outTransaction(w, &temp->data)) {
         temp = temp->next;
     }
-    printf("----------------------------------------------------------\n");
+    outEndList(w, "No upcoming recurring payments.");
 }
 
 void freeQueue(Queue* q) {
@@ -72,9 +68,10 @@ void freeQueue(Queue* q) {
 }
 
 void saveQueue(Queue* q, const char* filename) {
-    FILE* fp = fopen(filename, "w");
+    char tmpPath[256];
+    FILE* fp = openForReplace(filename, "w", tmpPath, sizeof(tmpPath));
     if (!fp) {
-        printf("Error: Could not open file %s for writing.\n", filename);
+        statusPrintf("Error: Could not open file %s for writing.\n", filename);
         return;
     }
 
@@ -89,7 +86,9 @@ void saveQueue(Queue* q, const char* filename) {
             temp->data.description);
         temp = temp->next;
     }
-    fclose(fp);
+    if (!commitReplaceSynced(fp, tmpPath, filename)) {
+        statusPrintf("Error: Could not save %s.\n", filename);
+    }
 }
 
 void loadQueue(Queue* q, const char* filename) {
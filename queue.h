@@ -2,6 +2,7 @@
 #define QUEUE_H
 
 #include "common.h"
+#include "output.h"
 
 typedef struct QueueNode {
     Transaction data;
@@ -17,6 +18,7 @@ void enqueue(Queue* q, Transaction data);
 Transaction dequeue(Queue* q);
 int isQueueEmpty(Queue* q);
 void displayQueue(Queue* q);
+void writeQueue(Queue* q, OutputWriter* w);
 void freeQueue(Queue* q);
 void saveQueue(Queue* q, const char* filename);
 void loadQueue(Queue* q, const char* filename);
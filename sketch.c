@@ -0,0 +1,425 @@
+#include "sketch.h"
+#include "file_ops.h"
+#include "writebehind.h"
+#include "snapshot.h"
+#include <stdint.h>
+#include <ctype.h>
+
+typedef struct {
+    char magic[4];
+    int version;
+    long generation;
+    long dataSize;
+    int count;
+} SketchHeader;
+
+static unsigned int sketchHash(const char* category, int period) {
+    unsigned int h = 2166136261u;
+    for (const char* p = category; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    h ^= (unsigned int)period;
+    h *= 16777619u;
+    return h;
+}
+
+static void rehash(SketchBook* b, int slotCount) {
+    free(b->slots);
+    b->slots = (int*)calloc(slotCount, sizeof(int));
+    b->slotCount = slotCount;
+    for (int i = 0; i < b->count; i++) {
+        unsigned int h = sketchHash(b->entries[i].category, b->entries[i].period) & (slotCount - 1);
+        while (b->slots[h]) h = (h + 1) & (slotCount - 1);
+        b->slots[h] = i + 1;
+    }
+}
+
+static SpendSketch* findSketch(const SketchBook* b, const char* category, int period) {
+    if (b->slotCount == 0) return NULL;
+    unsigned int h = sketchHash(category, period) & (b->slotCount - 1);
+    while (b->slots[h]) {
+        SpendSketch* e = &b->entries[b->slots[h] - 1];
+        if (e->period == period && strcmp(e->category, category) == 0) return e;
+        h = (h + 1) & (b->slotCount - 1);
+    }
+    return NULL;
+}
+
+static SpendSketch* addSketch(SketchBook* b, const char* category, int period) {
+    if (b->count == b->capacity) {
+        int capacity = b->capacity ? b->capacity * 2 : 16;
+        SpendSketch* grown = (SpendSketch*)realloc(b->entries, sizeof(SpendSketch) * capacity);
+        if (!grown) return NULL;
+        b->entries = grown;
+        b->capacity = capacity;
+    }
+    SpendSketch* e = &b->entries[b->count++];
+    memset(e, 0, sizeof(SpendSketch));
+    strncpy(e->category, category, MAX_CAT - 1);
+    e->period = period;
+
+    if (b->count * 2 > b->slotCount) {
+        rehash(b, b->slotCount ? b->slotCount * 2 : 32);
+    } else {
+        unsigned int h = sketchHash(e->category, period) & (b->slotCount - 1);
+        while (b->slots[h]) h = (h + 1) & (b->slotCount - 1);
+        b->slots[h] = b->count;
+    }
+    return e;
+}
+
+static SpendSketch* sketchFor(SketchBook* b, const char* category, int period) {
+    SpendSketch* e = findSketch(b, category, period);
+    return e ? e : addSketch(b, category, period);
+}
+
+SketchBook* createSketchBook(void) {
+    return (SketchBook*)calloc(1, sizeof(SketchBook));
+}
+
+void freeSketchBook(SketchBook* b) {
+    if (!b) return;
+    for (int i = 0; i < b->count; i++) free(b->entries[i].bins);
+    free(b->entries);
+    free(b->slots);
+    free(b);
+}
+
+// Bin index from the binary exponent and the top mantissa bits, i.e. a
+// piecewise-linear log2 that needs no libm.
+static int binIndex(double amount) {
+    uint64_t bits;
+    memcpy(&bits, &amount, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+    int fraction = (int)((bits >> 47) & (SKETCH_BINS_PER_OCTAVE - 1));
+    return exponent * SKETCH_BINS_PER_OCTAVE + fraction;
+}
+
+// Midpoint of a bin's value range.
+static double binValue(int index) {
+    int exponent = index >= 0 ? index / SKETCH_BINS_PER_OCTAVE : -((-index + SKETCH_BINS_PER_OCTAVE - 1) / SKETCH_BINS_PER_OCTAVE);
+    int fraction = index - exponent * SKETCH_BINS_PER_OCTAVE;
+    uint64_t bits = ((uint64_t)(exponent + 1023) << 52) | ((uint64_t)(2 * fraction + 1) << 46);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void addToBin(SpendSketch* e, int index, int delta) {
+    int lo = 0, hi = e->binCount;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (e->bins[mid].index < index) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < e->binCount && e->bins[lo].index == index) {
+        e->bins[lo].count += delta;
+        if (e->bins[lo].count <= 0) {
+            memmove(&e->bins[lo], &e->bins[lo + 1], sizeof(SketchBin) * (e->binCount - lo - 1));
+            e->binCount--;
+        }
+        return;
+    }
+    if (delta <= 0) return;
+    if (e->binCount == e->binCapacity) {
+        int capacity = e->binCapacity ? e->binCapacity * 2 : 8;
+        SketchBin* grown = (SketchBin*)realloc(e->bins, sizeof(SketchBin) * capacity);
+        if (!grown) return;
+        e->bins = grown;
+        e->binCapacity = capacity;
+    }
+    memmove(&e->bins[lo + 1], &e->bins[lo], sizeof(SketchBin) * (e->binCount - lo));
+    e->bins[lo].index = index;
+    e->bins[lo].count = delta;
+    e->binCount++;
+}
+
+static void addAmount(SpendSketch* e, double amount, int delta) {
+    e->count += delta;
+    if (amount <= 0) e->zeroCount += delta;
+    else addToBin(e, binIndex(amount), delta);
+}
+
+// Case-insensitive with whitespace trimmed, finished with a 64-bit mix so
+// the top bits are usable as the register index.
+static uint64_t descriptionHash(const char* s) {
+    uint64_t h = 14695981039346656037ULL;
+    while (isspace((unsigned char)*s)) s++;
+    size_t n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1])) n--;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)tolower((unsigned char)s[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void hllAdd(unsigned char* hll, const char* description) {
+    uint64_t h = descriptionHash(description);
+    int reg = (int)(h >> (64 - HLL_BITS));
+    uint64_t rest = h << HLL_BITS;
+    unsigned char rank = 1;
+    while (rank <= 64 - HLL_BITS && !(rest & 0x8000000000000000ULL)) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > hll[reg]) hll[reg] = rank;
+}
+
+static int isExpense(const Transaction* t) {
+    return strcmp(t->type, "Expense") == 0;
+}
+
+static int periodOf(const Transaction* t) {
+    return t->date.year * 100 + t->date.month;
+}
+
+// HyperLogLog registers only grow, so deletes mark their bucket stale and
+// the stale buckets' registers are rebuilt, together, in one pass over the
+// rows still present before the sketches are saved.
+static void rebuildStaleDistinct(AppState* s) {
+    SketchBook* b = s->sketches;
+    int stale = 0;
+    for (int i = 0; i < b->count; i++) {
+        if (b->entries[i].distinctStale) {
+            memset(b->entries[i].hll, 0, sizeof(b->entries[i].hll));
+            stale = 1;
+        }
+    }
+    if (!stale) return;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+        if (!isExpense(&temp->data)) continue;
+        SpendSketch* e = findSketch(b, temp->data.category, periodOf(&temp->data));
+        if (e && e->distinctStale) hllAdd(e->hll, temp->data.description);
+    }
+    for (int i = 0; i < b->count; i++) b->entries[i].distinctStale = 0;
+}
+
+static void rebuildSketches(AppState* s) {
+    SketchBook* b = s->sketches;
+    for (int i = 0; i < b->count; i++) free(b->entries[i].bins);
+    b->count = 0;
+    rehash(b, b->slotCount ? b->slotCount : 32);
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+        if (!isExpense(&temp->data)) continue;
+        SpendSketch* e = sketchFor(b, temp->data.category, periodOf(&temp->data));
+        if (!e) continue;
+        addAmount(e, temp->data.amount, 1);
+        hllAdd(e->hll, temp->data.description);
+    }
+}
+
+// Each sketch is written field by field (category, period, count,
+// zeroCount, binCount, registers) followed by its (index, count) bins, so
+// the file holds no pointers or struct padding.
+static int writeBins(FILE* fp, const SketchBin* bins, int n) {
+    for (int i = 0; i < n; i++) {
+        if (fwrite(&bins[i].index, sizeof(int), 1, fp) != 1 ||
+            fwrite(&bins[i].count, sizeof(int), 1, fp) != 1) return 0;
+    }
+    return 1;
+}
+
+static int readBins(FILE* fp, SketchBin* bins, int n) {
+    for (int i = 0; i < n; i++) {
+        if (fread(&bins[i].index, sizeof(int), 1, fp) != 1 ||
+            fread(&bins[i].count, sizeof(int), 1, fp) != 1) return 0;
+    }
+    return 1;
+}
+
+// Like budgets, sketches are trusted only if saved at the current
+// generation against a data file of the current size. Checking that does
+// not need the transactions, so a valid file is all a stats query reads.
+void loadSketches(AppState* s) {
+    s->sketches = createSketchBook();
+
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "sketches");
+    FILE* fp = fopen(path, "rb");
+    SketchHeader h;
+    int ok = 0;
+    if (fp && fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, SKETCH_MAGIC, 4) == 0 && h.version == SKETCH_VERSION) {
+        ok = 1;
+        for (int i = 0; i < h.count && ok; i++) {
+            char category[MAX_CAT];
+            int period, binCount;
+            ok = fread(category, sizeof(category), 1, fp) == 1 &&
+                 fread(&period, sizeof(int), 1, fp) == 1;
+            category[MAX_CAT - 1] = '\0';
+            SpendSketch* e = ok ? addSketch(s->sketches, category, period) : NULL;
+            if (!e) break;
+            ok = fread(&e->count, sizeof(int), 1, fp) == 1 &&
+                 fread(&e->zeroCount, sizeof(int), 1, fp) == 1 &&
+                 fread(&binCount, sizeof(int), 1, fp) == 1 && binCount >= 0 &&
+                 fread(e->hll, sizeof(e->hll), 1, fp) == 1;
+            if (!ok) break;
+            e->bins = (SketchBin*)malloc(sizeof(SketchBin) * (binCount > 0 ? binCount : 1));
+            e->binCapacity = binCount;
+            ok = e->bins != NULL && readBins(fp, e->bins, binCount);
+            e->binCount = ok ? binCount : 0;
+        }
+    }
+    if (fp) fclose(fp);
+
+    int entries;
+    long generation = isLoaded(s, NEED_TRANSACTIONS) ? s->generation : currentGeneration(s->filename, &entries);
+    if (!ok || h.generation != generation || h.dataSize != fileSize(s->filename)) {
+        ensureLoaded(s, NEED_TRANSACTIONS);
+        rebuildSketches(s);
+        saveSketches(s);
+    }
+}
+
+void saveSketches(AppState* s) {
+    SketchBook* b = s->sketches;
+    if (!b) return;
+    rebuildStaleDistinct(s);
+
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), s->filename, "sketches");
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+
+    SketchHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SKETCH_MAGIC, 4);
+    h.version = SKETCH_VERSION;
+    h.generation = s->generation;
+    h.dataSize = fileSize(s->filename);
+    h.count = b->count;
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    for (int i = 0; i < b->count && ok; i++) {
+        const SpendSketch* e = &b->entries[i];
+        ok = fwrite(e->category, sizeof(e->category), 1, fp) == 1 &&
+             fwrite(&e->period, sizeof(int), 1, fp) == 1 &&
+             fwrite(&e->count, sizeof(int), 1, fp) == 1 &&
+             fwrite(&e->zeroCount, sizeof(int), 1, fp) == 1 &&
+             fwrite(&e->binCount, sizeof(int), 1, fp) == 1 &&
+             fwrite(e->hll, sizeof(e->hll), 1, fp) == 1 &&
+             writeBins(fp, e->bins, e->binCount);
+    }
+    if (ok) {
+        commitReplace(fp, tmpPath, path);
+    } else {
+        fclose(fp);
+        remove(tmpPath);
+    }
+}
+
+void freeSketches(AppState* s) {
+    freeSketchBook(s->sketches);
+    s->sketches = NULL;
+}
+
+void sketchOnAdd(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_SKETCHES) || !isExpense(t)) return;
+    SpendSketch* e = sketchFor(s->sketches, t->category, periodOf(t));
+    if (!e) return;
+    addAmount(e, t->amount, 1);
+    hllAdd(e->hll, t->description);
+    if (!deferSave(s, DIRTY_SKETCHES)) saveSketches(s);
+}
+
+void sketchOnDelete(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_SKETCHES) || !isExpense(t)) return;
+    SpendSketch* e = findSketch(s->sketches, t->category, periodOf(t));
+    if (!e) return;
+    addAmount(e, t->amount, -1);
+    e->distinctStale = 1;
+    if (!deferSave(s, DIRTY_SKETCHES)) saveSketches(s);
+}
+
+static void mergeSketch(SpendSketch* into, const SpendSketch* from) {
+    into->count += from->count;
+    into->zeroCount += from->zeroCount;
+    for (int i = 0; i < from->binCount; i++) addToBin(into, from->bins[i].index, from->bins[i].count);
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        if (from->hll[i] > into->hll[i]) into->hll[i] = from->hll[i];
+    }
+}
+
+// Folds every month of 'from' (or just 'period', if non-zero) into one
+// sketch per category in 'into'.
+void mergeSketchBook(SketchBook* into, const SketchBook* from, int period) {
+    for (int i = 0; i < from->count; i++) {
+        const SpendSketch* e = &from->entries[i];
+        if (period && e->period != period) continue;
+        SpendSketch* target = sketchFor(into, e->category, 0);
+        if (target) mergeSketch(target, e);
+    }
+}
+
+static double quantile(const SpendSketch* e, double q) {
+    if (e->count <= 0) return 0;
+    long rank = (long)(q * (e->count - 1) + 0.5);
+    if (rank < e->zeroCount) return 0;
+    long seen = e->zeroCount;
+    for (int i = 0; i < e->binCount; i++) {
+        seen += e->bins[i].count;
+        if (rank < seen) return binValue(e->bins[i].index);
+    }
+    return e->binCount ? binValue(e->bins[e->binCount - 1].index) : 0;
+}
+
+// ln(x) = e*ln2 + 2*atanh((m-1)/(m+1)) for x = m*2^e, m in [1,2).
+static double naturalLog(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7ff) - 1023;
+    bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    double y = (m - 1) / (m + 1), y2 = y * y, term = y, sum = 0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= y2;
+    }
+    return exponent * 0.6931471805599453 + 2 * sum;
+}
+
+static double distinctCount(const unsigned char* hll) {
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < HLL_REGISTERS; i++) {
+        sum += 1.0 / (double)(1ULL << hll[i]);
+        if (hll[i] == 0) zeros++;
+    }
+    double m = HLL_REGISTERS;
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0) estimate = m * naturalLog(m / zeros);
+    return estimate;
+}
+
+static void printStatsRow(const char* label, const SpendSketch* e) {
+    printf("%-15s %-7d %-10.2f %-10.2f %-10.2f %-10.2f %-8.0f\n", label, e->count,
+           quantile(e, 0.5), quantile(e, 0.9), quantile(e, 0.95), quantile(e, 0.99), distinctCount(e->hll));
+}
+
+// Expects one sketch per category, as built by mergeSketchBook().
+void displayStats(const SketchBook* b) {
+    SpendSketch all;
+    memset(&all, 0, sizeof(all));
+    for (int i = 0; i < b->count; i++) mergeSketch(&all, &b->entries[i]);
+    if (all.count == 0) {
+        printf("No expenses recorded.\n");
+        free(all.bins);
+        return;
+    }
+
+    printf("\n%-15s %-7s %-10s %-10s %-10s %-10s %-8s\n", "Category", "Count", "Median", "P90", "P95", "P99", "Distinct");
+    printf("--------------------------------------------------------------------------\n");
+    for (int i = 0; i < b->count; i++) {
+        if (b->entries[i].count > 0) printStatsRow(b->entries[i].category, &b->entries[i]);
+    }
+    printf("--------------------------------------------------------------------------\n");
+    printStatsRow("All", &all);
+    free(all.bins);
+}
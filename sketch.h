@@ -0,0 +1,54 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include "common.h"
+#include "appstate.h"
+
+#define SKETCH_MAGIC "EXPK"
+#define SKETCH_VERSION 3
+#define SKETCH_BINS_PER_OCTAVE 32
+#define HLL_BITS 10
+#define HLL_REGISTERS (1 << HLL_BITS)
+
+// Per (category, month) summaries of expenses. Amounts go into
+// logarithmic bins (SKETCH_BINS_PER_OCTAVE per doubling, so quantiles are
+// within ~1.6% relative error) whose counts can be added and removed;
+// descriptions go into a HyperLogLog for distinct counts. Both merge by
+// adding counts / taking register maxima, across months or accounts.
+typedef struct {
+    int index;
+    int count;
+} SketchBin;
+
+typedef struct {
+    char category[MAX_CAT];
+    int period;
+    int count;
+    int zeroCount;
+    SketchBin* bins;
+    int binCount;
+    int binCapacity;
+    int distinctStale;  // set by deletes until the registers are rebuilt
+    unsigned char hll[HLL_REGISTERS];
+} SpendSketch;
+
+struct SketchBook {
+    SpendSketch* entries;
+    int count;
+    int capacity;
+    int* slots;
+    int slotCount;
+};
+
+void loadSketches(AppState* s);
+void saveSketches(AppState* s);
+void freeSketches(AppState* s);
+void sketchOnAdd(AppState* s, const Transaction* t);
+void sketchOnDelete(AppState* s, const Transaction* t);
+
+SketchBook* createSketchBook(void);
+void freeSketchBook(SketchBook* b);
+void mergeSketchBook(SketchBook* into, const SketchBook* from, int period);
+void displayStats(const SketchBook* b);
+
+#endif
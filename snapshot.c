@@ -0,0 +1,336 @@
+#include "snapshot.h"
+#include "file_ops.h"
+#include "utils.h"
+#include "metrics.h"
+#include "cache.h"
+
+typedef struct {
+    char magic[4];
+    int version;
+    long generation;
+    long dataSize;
+    int count;
+    long rowBytes;
+    double totalIncome;
+    double totalExpense;
+    uint64_t digest;
+} SnapshotHeader;
+
+static unsigned int checksum(unsigned int h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const Transaction* sortRows;
+
+static int compareByAmount(const void* a, const void* b) {
+    int ia = *(const int*)a;
+    int ib = *(const int*)b;
+    if (sortRows[ia].amount < sortRows[ib].amount) return -1;
+    if (sortRows[ia].amount > sortRows[ib].amount) return 1;
+    return ia - ib;
+}
+
+static int readJournalEntry(FILE* fp, long* gen, char* op, long* size, Transaction* t) {
+    return fscanf(fp, "%ld %c %ld %d %d %d %d %lf %s %s %[^\n]",
+                  gen, op, size,
+                  &t->id,
+                  &t->date.day, &t->date.month, &t->date.year,
+                  &t->amount,
+                  t->type,
+                  t->category,
+                  t->description) == 11;
+}
+
+long lastJournalGeneration(const char* filename, int* entries) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "journal");
+    *entries = 0;
+
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    long gen = 0, size;
+    long last = 0;
+    char op;
+    Transaction t;
+    while (readJournalEntry(fp, &gen, &op, &size, &t)) {
+        last = gen;
+        (*entries)++;
+    }
+    fclose(fp);
+    return last;
+}
+
+// The journal is emptied by each checkpoint, so the newest generation is
+// whichever is larger: the snapshot's or the last journaled one.
+long currentGeneration(const char* filename, int* entries) {
+    long gen = lastJournalGeneration(filename, entries);
+
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, "snap");
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return gen;
+    SnapshotHeader h;
+    if (fread(&h, sizeof(h), 1, fp) == 1 && memcmp(h.magic, SNAPSHOT_MAGIC, 4) == 0 && h.generation > gen) {
+        gen = h.generation;
+    }
+    fclose(fp);
+    return gen;
+}
+
+void journalChange(AppState* s, char op, const Transaction* t) {
+    journalChanges(s, op, t, 1);
+}
+
+// Bulk form: one open of the journal for all n rows. Every entry records
+// the data file's current size, so the file must already be saved.
+void journalChanges(AppState* s, char op, const Transaction* rows, int n) {
+    if (n <= 0) return;
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "journal");
+
+    long size = fileSize(s->filename);
+    FILE* fp = fopen(path, "a");
+    for (int i = 0; i < n; i++) {
+        const Transaction* t = &rows[i];
+        s->generation++;
+        s->journalLength++;
+        if (s->snapRows) {
+            // Only appends keep the snapshot rows a prefix of the list.
+            if (op == JOURNAL_ADD) s->snapAdds++;
+            else dropSnapshotIndex(s);
+        }
+        if (!fp) continue;
+        fprintf(fp, "%ld %c %ld %d %d %d %d %.2f %s %s %s\n",
+                s->generation, op, size,
+                t->id,
+                t->date.day, t->date.month, t->date.year,
+                t->amount,
+                t->type,
+                t->category,
+                t->description);
+    }
+    if (fp) fclose(fp);
+}
+
+static void discardLoaded(AppState* s) {
+    freeList(s->head);
+    s->head = NULL;
+    dropSnapshotIndex(s);
+    s->count = 0;
+    s->totalIncome = 0;
+    s->totalExpense = 0;
+    s->digest = 0;
+    s->generation = 0;
+    s->journalLength = 0;
+}
+
+int loadSnapshot(AppState* s) {
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "snap");
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    SnapshotHeader h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 ||
+        memcmp(h.magic, SNAPSHOT_MAGIC, 4) != 0 ||
+        h.version != SNAPSHOT_VERSION || h.count < 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    // The rows are stored with encodeRow; the file must hold exactly the
+    // header, the encoded rows, the amount order and the checksum.
+    long expectedFile = (long)sizeof(h) + h.rowBytes + (long)sizeof(int) * h.count + (long)sizeof(unsigned int);
+    if (h.rowBytes < (long)ROW_FIXED_BYTES * h.count || h.rowBytes > (long)ROW_MAX_BYTES * h.count ||
+        fileSize(path) != expectedFile) {
+        fclose(fp);
+        return 0;
+    }
+
+    unsigned char* encoded = (unsigned char*)malloc(h.rowBytes + 1);
+    Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * (h.count + 1));
+    int* order = (int*)malloc(sizeof(int) * (h.count + 1));
+    unsigned int stored = 0;
+    int ok = encoded && rows && order &&
+             fread(encoded, 1, h.rowBytes, fp) == (size_t)h.rowBytes &&
+             fread(order, sizeof(int), h.count, fp) == (size_t)h.count &&
+             fread(&stored, sizeof(stored), 1, fp) == 1;
+    fclose(fp);
+
+    unsigned int sum = 2166136261u;
+    if (ok) {
+        sum = checksum(sum, encoded, h.rowBytes);
+        sum = checksum(sum, order, sizeof(int) * h.count);
+        sum = checksum(sum, &h, sizeof(h));
+        const unsigned char* p = encoded;
+        const unsigned char* end = encoded + h.rowBytes;
+        for (int i = 0; ok && i < h.count; i++) ok = decodeRow(&p, end, &rows[i]);
+        ok = ok && p == end;
+        for (int i = 0; ok && i < h.count; i++) ok = order[i] >= 0 && order[i] < h.count;
+    }
+    free(encoded);
+    if (!ok || sum != stored) {
+        free(rows);
+        free(order);
+        return 0;
+    }
+
+    Node* tail = NULL;
+    for (int i = 0; i < h.count; i++) {
+        Node* node = createNode(rows[i]);
+        if (tail) tail->next = node;
+        else s->head = node;
+        tail = node;
+    }
+    s->count = h.count;
+    metrics.rowsRestored += h.count;
+    s->totalIncome = h.totalIncome;
+    s->totalExpense = h.totalExpense;
+    s->digest = h.digest;
+    s->generation = h.generation;
+    s->journalLength = 0;
+    s->snapRows = rows;
+    s->snapOrder = order;
+    s->snapCount = h.count;
+    s->snapAdds = 0;
+
+    long expectedSize = h.dataSize;
+    sidecarPath(path, sizeof(path), s->filename, "journal");
+    FILE* jp = fopen(path, "r");
+    if (jp) {
+        long gen, size;
+        char op;
+        Transaction t;
+        while (readJournalEntry(jp, &gen, &op, &size, &t)) {
+            if (gen <= h.generation) continue;
+            if (gen != s->generation + 1) {
+                ok = 0;
+                break;
+            }
+            if (op == JOURNAL_ADD) {
+                Node* node = createNode(t);
+                if (tail) tail->next = node;
+                else s->head = node;
+                tail = node;
+                applyTotals(s, &t, 1);
+                s->snapAdds++;
+            } else if (op == JOURNAL_DELETE) {
+                if (deleteNode(&s->head, t.id)) applyTotals(s, &t, -1);
+                tail = NULL;
+                dropSnapshotIndex(s);
+            }
+            if (tail == NULL) {
+                for (tail = s->head; tail && tail->next; tail = tail->next);
+            }
+            s->generation = gen;
+            s->journalLength++;
+            expectedSize = size;
+        }
+        fclose(jp);
+    }
+
+    if (!ok || fileSize(s->filename) != expectedSize) {
+        discardLoaded(s);
+        return 0;
+    }
+
+    s->fromSnapshot = 1;
+    printLoadMessage(s->filename);
+    return 1;
+}
+
+// Restores the amount index from the snapshot's precomputed order instead
+// of re-inserting every row, then adds anything journaled since.
+void buildIndexFromSnapshot(AppState* s) {
+    freeBST(s->bstRoot);
+    s->bstRoot = buildBalancedBST(s->snapRows, s->snapOrder, 0, s->snapCount - 1);
+
+    int skip = s->count - s->snapAdds;
+    Node* temp = s->head;
+    for (int i = 0; temp != NULL; i++, temp = temp->next) {
+        if (i >= skip) s->bstRoot = insertBST(s->bstRoot, temp->data);
+    }
+    dropSnapshotIndex(s);
+}
+
+int writeSnapshot(AppState* s) {
+    long dataSize = fileSize(s->filename);
+    if (dataSize < 0) return 0;
+
+    Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * (s->count + 1));
+    int* order = (int*)malloc(sizeof(int) * (s->count + 1));
+    if (!rows || !order) {
+        free(rows);
+        free(order);
+        return 0;
+    }
+
+    int n = 0;
+    for (Node* temp = s->head; temp != NULL && n < s->count; temp = temp->next) {
+        rows[n] = temp->data;
+        order[n] = n;
+        n++;
+    }
+    sortRows = rows;
+    qsort(order, n, sizeof(int), compareByAmount);
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+    h.version = SNAPSHOT_VERSION;
+    h.generation = s->generation;
+    h.dataSize = dataSize;
+    h.count = n;
+    h.totalIncome = s->totalIncome;
+    h.totalExpense = s->totalExpense;
+    h.digest = s->digest;
+
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), s->filename, "snap");
+
+    // The header goes in last, once the encoded size is known; the
+    // checksum covers the rows, the order and then the header.
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    int ok = fp != NULL;
+    if (fp) {
+        unsigned int sum = 2166136261u;
+        unsigned char buf[ROW_MAX_BYTES];
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+        for (int i = 0; ok && i < n; i++) {
+            size_t len = encodeRow(buf, &rows[i]);
+            sum = checksum(sum, buf, len);
+            h.rowBytes += (long)len;
+            ok = fwrite(buf, 1, len, fp) == len;
+        }
+        sum = checksum(sum, order, sizeof(int) * n);
+        sum = checksum(sum, &h, sizeof(h));
+        ok = ok && fwrite(order, sizeof(int), n, fp) == (size_t)n &&
+             fwrite(&sum, sizeof(sum), 1, fp) == 1 &&
+             fseek(fp, 0, SEEK_SET) == 0 &&
+             fwrite(&h, sizeof(h), 1, fp) == 1;
+        if (ok) {
+            ok = commitReplace(fp, tmpPath, path);
+        } else {
+            fclose(fp);
+            remove(tmpPath);
+        }
+    }
+    free(rows);
+    free(order);
+    if (!ok) return 0;
+
+    // Everything in the journal is now covered by the snapshot.
+    sidecarPath(path, sizeof(path), s->filename, "journal");
+    fp = fopen(path, "w");
+    if (fp) fclose(fp);
+    s->journalLength = 0;
+    s->fromSnapshot = 1;
+    return 1;
+}
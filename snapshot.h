@@ -0,0 +1,27 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "common.h"
+#include "appstate.h"
+
+#define SNAPSHOT_MAGIC "EXPS"
+#define SNAPSHOT_VERSION 3
+#define CHECKPOINT_INTERVAL 256
+
+#define JOURNAL_ADD 'A'
+#define JOURNAL_DELETE 'D'
+
+// Fast startup: <file>.snap holds the transaction rows (in the sidecar row
+// encoding), their amount order, running totals and a checksum as of some
+// generation; <file>.journal holds every change made since. Loading
+// restores the snapshot and replays only the newer journal entries. The text file stays authoritative: if its size
+// does not match what the journal recorded, the snapshot is ignored.
+int loadSnapshot(AppState* s);
+int writeSnapshot(AppState* s);
+void buildIndexFromSnapshot(AppState* s);
+void journalChange(AppState* s, char op, const Transaction* t);
+void journalChanges(AppState* s, char op, const Transaction* rows, int n);
+long lastJournalGeneration(const char* filename, int* entries);
+long currentGeneration(const char* filename, int* entries);
+
+#endif
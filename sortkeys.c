@@ -0,0 +1,310 @@
+#include "sortkeys.h"
+#include "utils.h"
+
+typedef struct {
+    long long key[SORT_MAX_KEYS];
+    int index;
+} SortRecord;
+
+typedef struct {
+    const char* text;
+    int index;
+} RankEntry;
+
+static const char* fieldNames[] = {"id", "date", "amount", "type", "category", "description"};
+
+int parseSortSpec(const char* text, SortSpec* spec) {
+    spec->count = 0;
+    while (*text) {
+        int descending = 0;
+        if (*text == '-' || *text == '+') descending = *text++ == '-';
+        size_t len = strcspn(text, ",");
+        int field = -1;
+        for (int f = 0; f < (int)(sizeof(fieldNames) / sizeof(fieldNames[0])); f++) {
+            if (strlen(fieldNames[f]) == len && strncmp(text, fieldNames[f], len) == 0) field = f;
+        }
+        if (field < 0 || spec->count == SORT_MAX_KEYS) return 0;
+        spec->keys[spec->count].field = field;
+        spec->keys[spec->count].descending = descending;
+        spec->count++;
+        text += len;
+        if (*text == ',') text++;
+    }
+    return spec->count > 0;
+}
+
+static const char* fieldText(const Transaction* t, int field) {
+    if (field == SORT_TYPE) return t->type;
+    if (field == SORT_CATEGORY) return t->category;
+    return t->description;
+}
+
+static int compareRankEntries(const void* a, const void* b) {
+    return strcmp(((const RankEntry*)a)->text, ((const RankEntry*)b)->text);
+}
+
+// Replaces a string key by its rank among the distinct values, so each
+// string is compared O(log n) times here instead of at every sort step.
+static void rankStrings(const Transaction** rows, int n, int field, int k, SortRecord* records) {
+    RankEntry* entries = (RankEntry*)malloc(sizeof(RankEntry) * (n + 1));
+    for (int i = 0; i < n; i++) {
+        entries[i].text = fieldText(rows[i], field);
+        entries[i].index = i;
+    }
+    qsort(entries, n, sizeof(RankEntry), compareRankEntries);
+    long long rank = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && strcmp(entries[i].text, entries[i - 1].text) != 0) rank++;
+        records[entries[i].index].key[k] = rank;
+    }
+    free(entries);
+}
+
+static void buildRecords(const Transaction** rows, int n, const SortSpec* spec, SortRecord* records) {
+    memset(records, 0, sizeof(SortRecord) * n);
+    for (int k = 0; k < spec->count; k++) {
+        int field = spec->keys[k].field;
+        if (field == SORT_TYPE || field == SORT_CATEGORY || field == SORT_DESCRIPTION) {
+            rankStrings(rows, n, field, k, records);
+        } else {
+            for (int i = 0; i < n; i++) {
+                const Transaction* t = rows[i];
+                if (field == SORT_ID) records[i].key[k] = t->id;
+                else if (field == SORT_DATE) records[i].key[k] = dateKey(t->date);
+                else records[i].key[k] = (long long)(t->amount * 100 + (t->amount < 0 ? -0.5 : 0.5));
+            }
+        }
+        if (spec->keys[k].descending) {
+            for (int i = 0; i < n; i++) records[i].key[k] = -records[i].key[k];
+        }
+    }
+    for (int i = 0; i < n; i++) records[i].index = i;
+}
+
+#define COMPARE_KEY(k) \
+    if (ra->key[k] != rb->key[k]) return ra->key[k] < rb->key[k] ? -1 : 1;
+
+static int compareRecords1(const void* a, const void* b) {
+    const SortRecord* ra = (const SortRecord*)a;
+    const SortRecord* rb = (const SortRecord*)b;
+    COMPARE_KEY(0)
+    return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+static int compareRecords2(const void* a, const void* b) {
+    const SortRecord* ra = (const SortRecord*)a;
+    const SortRecord* rb = (const SortRecord*)b;
+    COMPARE_KEY(0)
+    COMPARE_KEY(1)
+    return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+static int compareRecords3(const void* a, const void* b) {
+    const SortRecord* ra = (const SortRecord*)a;
+    const SortRecord* rb = (const SortRecord*)b;
+    COMPARE_KEY(0)
+    COMPARE_KEY(1)
+    COMPARE_KEY(2)
+    return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+// Unused keys are zero in every record, so comparing all of them is safe.
+static int compareRecordsAll(const void* a, const void* b) {
+    const SortRecord* ra = (const SortRecord*)a;
+    const SortRecord* rb = (const SortRecord*)b;
+    for (int k = 0; k < SORT_MAX_KEYS; k++) {
+        COMPARE_KEY(k)
+    }
+    return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+static int (*const comparators[])(const void*, const void*) = {
+    compareRecords1, compareRecords1, compareRecords2, compareRecords3,
+};
+
+// Leaves records in sorted order; records[i].index is the original row.
+static SortRecord* orderRecords(const Transaction** rows, int n, const SortSpec* spec) {
+    SortRecord* records = (SortRecord*)malloc(sizeof(SortRecord) * (n + 1));
+    buildRecords(rows, n, spec, records);
+    int count = spec->count;
+    qsort(records, n, sizeof(SortRecord), count <= 3 ? comparators[count] : compareRecordsAll);
+    return records;
+}
+
+void sortByKeys(Transaction* rows, int n, const SortSpec* spec) {
+    if (n < 2) return;
+    const Transaction** refs = (const Transaction**)malloc(sizeof(Transaction*) * n);
+    for (int i = 0; i < n; i++) refs[i] = &rows[i];
+    SortRecord* records = orderRecords(refs, n, spec);
+
+    Transaction* sorted = (Transaction*)malloc(sizeof(Transaction) * n);
+    for (int i = 0; i < n; i++) sorted[i] = rows[records[i].index];
+    memcpy(rows, sorted, sizeof(Transaction) * n);
+    free(sorted);
+    free(records);
+    free(refs);
+}
+
+// Relinks the existing nodes; no row is copied.
+void sortListByKeys(Node** head, const SortSpec* spec) {
+    int n = 0;
+    for (Node* temp = *head; temp != NULL; temp = temp->next) n++;
+    if (n < 2) return;
+
+    Node** nodes = (Node**)malloc(sizeof(Node*) * n);
+    const Transaction** refs = (const Transaction**)malloc(sizeof(Transaction*) * n);
+    n = 0;
+    for (Node* temp = *head; temp != NULL; temp = temp->next) {
+        nodes[n] = temp;
+        refs[n++] = &temp->data;
+    }
+    SortRecord* records = orderRecords(refs, n, spec);
+
+    *head = nodes[records[0].index];
+    for (int i = 0; i < n - 1; i++) nodes[records[i].index]->next = nodes[records[i + 1].index];
+    nodes[records[n - 1].index]->next = NULL;
+    free(records);
+    free(refs);
+    free(nodes);
+}
+
+// Compares two rows directly by the spec, for merging runs whose string
+// ranks were computed separately.
+int compareByKeys(const Transaction* a, const Transaction* b, const SortSpec* spec) {
+    for (int k = 0; k < spec->count; k++) {
+        int field = spec->keys[k].field;
+        int c;
+        if (field == SORT_TYPE || field == SORT_CATEGORY || field == SORT_DESCRIPTION) {
+            c = strcmp(fieldText(a, field), fieldText(b, field));
+        } else {
+            long long x, y;
+            if (field == SORT_ID) {
+                x = a->id;
+                y = b->id;
+            } else if (field == SORT_DATE) {
+                x = dateKey(a->date);
+                y = dateKey(b->date);
+            } else {
+                x = (long long)(a->amount * 100 + (a->amount < 0 ? -0.5 : 0.5));
+                y = (long long)(b->amount * 100 + (b->amount < 0 ? -0.5 : 0.5));
+            }
+            c = (x > y) - (x < y);
+        }
+        if (c != 0) return spec->keys[k].descending ? -c : c;
+    }
+    return 0;
+}
+
+void runSorterInit(RunSorter* r, const SortSpec* spec) {
+    memset(r, 0, sizeof(RunSorter));
+    r->spec = spec;
+}
+
+static int spillRun(RunSorter* r) {
+    if (!r->spill) r->spill = tmpfile();
+    if (!r->spill) return 0;
+    if (r->runCount == r->runCapacity) {
+        int capacity = r->runCapacity ? r->runCapacity * 2 : 16;
+        long* grown = (long*)realloc(r->runStarts, sizeof(long) * (capacity + 1));
+        if (!grown) return 0;
+        r->runStarts = grown;
+        r->runCapacity = capacity;
+    }
+    sortByKeys(r->rows, r->count, r->spec);
+    if (fseek(r->spill, r->spilled * (long)sizeof(Transaction), SEEK_SET) != 0 ||
+        fwrite(r->rows, sizeof(Transaction), r->count, r->spill) != (size_t)r->count) {
+        return 0;
+    }
+    r->runStarts[r->runCount++] = r->spilled;
+    r->spilled += r->count;
+    r->count = 0;
+    return 1;
+}
+
+// A TransactionVisitor; ctx is the RunSorter. If spilling fails the run
+// just keeps growing in memory.
+int runSorterAdd(const Transaction* t, void* ctx) {
+    RunSorter* r = (RunSorter*)ctx;
+    if (r->count == r->capacity) {
+        if (r->capacity < SORT_RUN_ROWS || !spillRun(r)) {
+            int capacity = r->capacity ? r->capacity * 2 : 64;
+            Transaction* grown = (Transaction*)realloc(r->rows, sizeof(Transaction) * capacity);
+            if (!grown) return 0;
+            r->rows = grown;
+            r->capacity = capacity;
+        }
+    }
+    r->rows[r->count++] = *t;
+    return 1;
+}
+
+typedef struct {
+    long next;
+    long end;
+    int pos;
+    int len;
+    Transaction buf[SORT_MERGE_ROWS];
+} MergeRun;
+
+static int refillRun(FILE* spill, MergeRun* m) {
+    long n = m->end - m->next;
+    if (n > SORT_MERGE_ROWS) n = SORT_MERGE_ROWS;
+    if (n <= 0 || fseek(spill, m->next * (long)sizeof(Transaction), SEEK_SET) != 0) return 0;
+    m->len = (int)fread(m->buf, sizeof(Transaction), n, spill);
+    m->next += m->len;
+    m->pos = 0;
+    return m->len > 0;
+}
+
+static int runBefore(MergeRun* runs, int a, int b, const SortSpec* spec) {
+    int c = compareByKeys(&runs[a].buf[runs[a].pos], &runs[b].buf[runs[b].pos], spec);
+    return c < 0 || (c == 0 && a < b);
+}
+
+static void siftDown(MergeRun* runs, int* heap, int n, int i, const SortSpec* spec) {
+    for (;;) {
+        int least = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && runBefore(runs, heap[l], heap[least], spec)) least = l;
+        if (r < n && runBefore(runs, heap[r], heap[least], spec)) least = r;
+        if (least == i) return;
+        int swap = heap[i];
+        heap[i] = heap[least];
+        heap[least] = swap;
+        i = least;
+    }
+}
+
+// Visits the rows in order until visit() returns 0, then frees the sorter.
+void runSorterFinish(RunSorter* r, TransactionVisitor visit, void* ctx) {
+    if (r->runCount > 0 && r->count > 0 && !spillRun(r)) {
+        printf("Error: Could not write sort runs to a temporary file.\n");
+    } else if (r->runCount == 0) {
+        sortByKeys(r->rows, r->count, r->spec);
+        for (int i = 0; i < r->count && visit(&r->rows[i], ctx); i++);
+    } else {
+        free(r->rows);
+        r->rows = NULL;
+        r->runStarts[r->runCount] = r->spilled;
+        MergeRun* runs = (MergeRun*)malloc(sizeof(MergeRun) * r->runCount);
+        int* heap = (int*)malloc(sizeof(int) * r->runCount);
+        int n = 0;
+        for (int i = 0; runs && heap && i < r->runCount; i++) {
+            runs[i].next = r->runStarts[i];
+            runs[i].end = r->runStarts[i + 1];
+            if (refillRun(r->spill, &runs[i])) heap[n++] = i;
+        }
+        for (int i = n / 2 - 1; i >= 0; i--) siftDown(runs, heap, n, i, r->spec);
+        while (n > 0) {
+            MergeRun* m = &runs[heap[0]];
+            if (!visit(&m->buf[m->pos], ctx)) break;
+            if (++m->pos == m->len && !refillRun(r->spill, m)) heap[0] = heap[--n];
+            siftDown(runs, heap, n, 0, r->spec);
+        }
+        free(runs);
+        free(heap);
+    }
+    if (r->spill) fclose(r->spill);
+    free(r->rows);
+    free(r->runStarts);
+    memset(r, 0, sizeof(RunSorter));
+}
@@ -0,0 +1,60 @@
+#ifndef SORTKEYS_H
+#define SORTKEYS_H
+
+#include "common.h"
+#include "linkedlist.h"
+#include "stream.h"
+
+#define SORT_MAX_KEYS 6
+
+#define SORT_ID 0
+#define SORT_DATE 1
+#define SORT_AMOUNT 2
+#define SORT_TYPE 3
+#define SORT_CATEGORY 4
+#define SORT_DESCRIPTION 5
+
+typedef struct {
+    int field;
+    int descending;
+} SortKey;
+
+typedef struct {
+    SortKey keys[SORT_MAX_KEYS];
+    int count;
+} SortSpec;
+
+// Multi-key ordering, e.g. "category,-amount,date" ('-' for descending).
+// Every key is first normalized to one integer per row (ids, yyyymmdd
+// dates, amounts in cents, strings by rank), negated when descending, so
+// the comparator only compares integers; one comparator is specialized
+// per key count. Ties keep their original order.
+int parseSortSpec(const char* text, SortSpec* spec);
+void sortByKeys(Transaction* rows, int n, const SortSpec* spec);
+void sortListByKeys(Node** head, const SortSpec* spec);
+int compareByKeys(const Transaction* a, const Transaction* b, const SortSpec* spec);
+
+#define SORT_RUN_ROWS 8192
+#define SORT_MERGE_ROWS 64
+
+// Sorts a stream of rows in bounded memory: every SORT_RUN_ROWS rows are
+// sorted and spilled to a temporary file, and finishing merges the runs
+// (ties go to the earlier run, so the sort stays stable). Input that fits
+// in one run never touches the disk.
+typedef struct {
+    const SortSpec* spec;
+    Transaction* rows;
+    int count;
+    int capacity;
+    FILE* spill;
+    long* runStarts;
+    int runCount;
+    int runCapacity;
+    long spilled;
+} RunSorter;
+
+void runSorterInit(RunSorter* r, const SortSpec* spec);
+int runSorterAdd(const Transaction* t, void* ctx);
+void runSorterFinish(RunSorter* r, TransactionVisitor visit, void* ctx);
+
+#endif
@@ -1,9 +1,12 @@
 #include "stack.h"
+#include "file_ops.h"
+#include "metrics.h"
 
 void push(StackNode** top, Transaction data, OperationType type) {
     StackNode* newNode = (StackNode*)malloc(sizeof(StackNode));
+    metrics.nodesAllocated++;
     if (!newNode) {
-        printf("Stack Overflow\n");
+        statusPrintf("Stack Overflow\n");
         return;
     }
     newNode->data = data;
@@ -15,7 +18,7 @@ void push(StackNode** top, Transaction data, OperationType type) {
 Transaction pop(StackNode** top, OperationType* type) {
     Transaction empty = {0};
     if (isStackEmpty(*top)) {
-        printf("Stack Underflow\n");
+        statusPrintf("Stack Underflow\n");
         return empty;
     }
     StackNode* temp = *top;
@@ -40,9 +43,10 @@ void freeStack(StackNode* top) {
 }
 
 void saveStack(StackNode* top, const char* filename) {
-    FILE* fp = fopen(filename, "w");
+    char tmpPath[256];
+    FILE* fp = openForReplace(filename, "w", tmpPath, sizeof(tmpPath));
     if (!fp) {
-        printf("Error: Could not open file %s for writing.\n", filename);
+        statusPrintf("Error: Could not open file %s for writing.\n", filename);
         return;
     }
 
@@ -58,7 +62,9 @@ void saveStack(StackNode* top, const char* filename) {
             temp->type);
         temp = temp->next;
     }
-    fclose(fp);
+    if (!commitReplaceSynced(fp, tmpPath, filename)) {
+        statusPrintf("Error: Could not save %s.\n", filename);
+    }
 }
 
 void loadStack(StackNode** top, const char* filename) {
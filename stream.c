@@ -0,0 +1,65 @@
+#include "stream.h"
+#include "file_ops.h"
+#include "metrics.h"
+#include "cache.h"
+
+static long scanRows(FILE* file, TransactionVisitor visit, void* ctx) {
+    static char ioBuf[STREAM_BUF_SIZE];
+    setvbuf(file, ioBuf, _IOFBF, sizeof(ioBuf));
+
+    char line[512];
+    long count = 0;
+    Transaction t;
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strlen(line);
+        if (len == sizeof(line) - 1 && line[len - 1] != '\n') {
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n');
+        }
+        if (sscanf(line, "%d %d %d %d %lf %9s %49s %99[^\n]",
+                   &t.id,
+                   &t.date.day, &t.date.month, &t.date.year,
+                   &t.amount,
+                   t.type,
+                   t.category,
+                   t.description) != 8) {
+            continue;
+        }
+        count++;
+        metrics.rowsParsed++;
+        if (!visit(&t, ctx)) break;
+    }
+    return count;
+}
+
+long streamTransactions(const char* filename, TransactionVisitor visit, void* ctx) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        printf("No existing data found. Starting fresh.\n");
+        return -1;
+    }
+    printLoadMessage(filename);
+    long count = scanRows(file, visit, ctx);
+    fclose(file);
+    return count;
+}
+
+static int visitFindId(const Transaction* t, void* ctx) {
+    int* id = (int*)ctx;
+    if (t->id != *id) return 1;
+    *id = 0;
+    return 0;
+}
+
+int streamHasId(const char* filename, int id) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) return 0;
+    scanRows(file, visitFindId, &id);
+    fclose(file);
+    return id == 0;
+}
+
+int shouldStream(const char* filename, int mode) {
+    if (mode != STREAM_AUTO) return mode == STREAM_ON;
+    return fileSize(filename) > STREAM_THRESHOLD_BYTES;
+}
@@ -0,0 +1,24 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+
+#define STREAM_THRESHOLD_BYTES (8L * 1024 * 1024)
+#define STREAM_BUF_SIZE 65536
+
+#define STREAM_AUTO -1
+#define STREAM_OFF 0
+#define STREAM_ON 1
+
+// Calls visit() for every row of the data file in a single pass, using
+// only fixed-size buffers: nothing is allocated per row. visit() returns 0
+// to stop early. Returns the number of rows visited, or -1 if the file
+// does not exist.
+typedef int (*TransactionVisitor)(const Transaction* t, void* ctx);
+
+long streamTransactions(const char* filename, TransactionVisitor visit, void* ctx);
+// Quietly checks whether a row with this id is in the data file.
+int streamHasId(const char* filename, int id);
+int shouldStream(const char* filename, int mode);
+
+#endif
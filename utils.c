@@ -1,103 +1,21 @@
 #include "utils.h"
+#include "sortkeys.h"
 
-Node* sortedMergeAmount(Node* a, Node* b);
-Node* sortedMergeDate(Node* a, Node* b);
-void splitList(Node* source, Node** frontRef, Node** backRef);
-
-void mergeSortAmount(Node** headRef) {
-    Node* head = *headRef;
-    Node* a;
-    Node* b;
-
-    if ((head == NULL) || (head->next == NULL)) {
-        return;
-    }
-
-    splitList(head, &a, &b);
-
-    mergeSortAmount(&a);
-    mergeSortAmount(&b);
-
-    *headRef = sortedMergeAmount(a, b);
-}
-
-Node* sortedMergeAmount(Node* a, Node* b) {
-    Node* result = NULL;
-
-    if (a == NULL) return b;
-    if (b == NULL) return a;
-
-    if (a->data.amount <= b->data.amount) {
-        result = a;
-        result->next = sortedMergeAmount(a->next, b);
-    } else {
-        result = b;
-        result->next = sortedMergeAmount(a, b->next);
-    }
-    return result;
-}
-
-void mergeSortDate(Node** headRef) {
-    Node* head = *headRef;
-    Node* a;
-    Node* b;
-
-    if ((head == NULL) || (head->next == NULL)) {
-        return;
-    }
-
-    splitList(head, &a, &b);
-
-    mergeSortDate(&a);
-    mergeSortDate(&b);
-
-    *headRef = sortedMergeDate(a, b);
-}
-
-Node* sortedMergeDate(Node* a, Node* b) {
-    Node* result = NULL;
-
-    if (a == NULL) return b;
-    if (b == NULL) return a;
-
-    int date1 = a->data.date.year * 10000 + a->data.date.month * 100 + a->data.date.day;
-    int date2 = b->data.date.year * 10000 + b->data.date.month * 100 + b->data.date.day;
-
-    if (date1 <= date2) {
-        result = a;
-        result->next = sortedMergeDate(a->next, b);
-    } else {
-        result = b;
-        result->next = sortedMergeDate(a, b->next);
-    }
-    return result;
-}
-
-void splitList(Node* source, Node** frontRef, Node** backRef) {
-    Node* fast;
-    Node* slow;
-    slow = source;
-    fast = source->next;
-
-    while (fast != NULL) {
-        fast = fast->next;
-        if (fast != NULL) {
-            slow = slow->next;
-            fast = fast->next;
-        }
-    }
-    *frontRef = source;
-    *backRef = slow->next;
-    slow->next = NULL;
+int dateKey(Date d) {
+    return d.year * 10000 + d.month * 100 + d.day;
 }
 
 void sortTransactionsByAmount(Node** head) {
-    mergeSortAmount(head);
+    SortSpec spec;
+    parseSortSpec("amount", &spec);
+    sortListByKeys(head, &spec);
     printf("Transactions sorted by Amount.\n");
 }
 
 void sortTransactionsByDate(Node** head) {
-    mergeSortDate(head);
+    SortSpec spec;
+    parseSortSpec("date", &spec);
+    sortListByKeys(head, &spec);
     printf("Transactions sorted by Date.\n");
 }
 
@@ -117,9 +35,97 @@ void getCategoryTotals(Node* head) {
         temp = temp->next;
     }
 
+    printFinancialSummary(totalIncome, totalExpense);
+}
+
+void printFinancialSummary(double totalIncome, double totalExpense) {
     printf("\n--- Financial Summary ---\n");
     printf("Total Income:  %.2f\n", totalIncome);
     printf("Total Expense: %.2f\n", totalExpense);
     printf("Net Savings:   %.2f\n", totalIncome - totalExpense);
     printf("-------------------------\n");
 }
+
+static int equalsIgnoreCase(const char* a, const char* b) {
+    while (*a && *b) {
+        char ca = (*a >= 'A' && *a <= 'Z') ? *a + 32 : *a;
+        char cb = (*b >= 'A' && *b <= 'Z') ? *b + 32 : *b;
+        if (ca != cb) return 0;
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// Heap ordered so the root is the weakest of the current k candidates:
+// the smallest amount when selecting largest, the largest otherwise.
+static int heapWeaker(const Transaction* a, const Transaction* b, int largest) {
+    return largest ? a->amount < b->amount : a->amount > b->amount;
+}
+
+static void heapSiftDown(Transaction* heap, int n, int i, int largest) {
+    while (1) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && heapWeaker(&heap[l], &heap[m], largest)) m = l;
+        if (r < n && heapWeaker(&heap[r], &heap[m], largest)) m = r;
+        if (m == i) return;
+        Transaction tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+static void heapSiftUp(Transaction* heap, int i, int largest) {
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (!heapWeaker(&heap[i], &heap[p], largest)) return;
+        Transaction tmp = heap[i];
+        heap[i] = heap[p];
+        heap[p] = tmp;
+        i = p;
+    }
+}
+
+int matchesFilter(const Transaction* t, const char* type, const char* category) {
+    if (type && !equalsIgnoreCase(t->type, type)) return 0;
+    if (category && !equalsIgnoreCase(t->category, category)) return 0;
+    return 1;
+}
+
+// Offers one row to a bounded heap of at most k rows.
+void topKOffer(Transaction* heap, int* n, int k, int largest, const Transaction* t) {
+    if (*n < k) {
+        heap[*n] = *t;
+        heapSiftUp(heap, *n, largest);
+        (*n)++;
+    } else if (k > 0 && heapWeaker(&heap[0], t, largest)) {
+        heap[0] = *t;
+        heapSiftDown(heap, *n, 0, largest);
+    }
+}
+
+// Pops the weakest to the back until the heap is ordered best first.
+void topKFinish(Transaction* heap, int n, int largest) {
+    for (int end = n - 1; end > 0; end--) {
+        Transaction tmp = heap[0];
+        heap[0] = heap[end];
+        heap[end] = tmp;
+        heapSiftDown(heap, end, 0, largest);
+    }
+}
+
+// Selects the k largest (or smallest) transactions matching the optional
+// type/category filters in one pass with a bounded heap, O(n log k), and
+// leaves the list untouched. result must hold k rows; it comes back
+// ordered best first. Returns the number of rows selected.
+int selectTopK(Node* head, int k, int largest, const char* type, const char* category, Transaction* result) {
+    int n = 0;
+    for (Node* temp = head; temp != NULL; temp = temp->next) {
+        if (matchesFilter(&temp->data, type, category)) {
+            topKOffer(result, &n, k, largest, &temp->data);
+        }
+    }
+    topKFinish(result, n, largest);
+    return n;
+}
@@ -4,8 +4,14 @@
 #include "common.h"
 #include "linkedlist.h"
 
+int dateKey(Date d);
 void sortTransactionsByAmount(Node** head);
 void sortTransactionsByDate(Node** head);
 void getCategoryTotals(Node* head);
+void printFinancialSummary(double totalIncome, double totalExpense);
+int matchesFilter(const Transaction* t, const char* type, const char* category);
+void topKOffer(Transaction* heap, int* n, int k, int largest, const Transaction* t);
+void topKFinish(Transaction* heap, int n, int largest);
+int selectTopK(Node* head, int k, int largest, const char* type, const char* category, Transaction* result);
 
 #endif
@@ -0,0 +1,380 @@
+#include "versions.h"
+#include "file_ops.h"
+#include <stdint.h>
+
+typedef struct {
+    char magic[4];
+    int version;
+} HistoryHeader;
+
+typedef struct {
+    Transaction data;
+    long left;
+    long right;
+} HistoryNode;
+
+typedef struct {
+    FILE* fp;
+    long size;
+} NodeFile;
+
+static FILE* createHistoryFile(const char* path) {
+    FILE* fp = fopen(path, "w+b");
+    if (fp) {
+        HistoryHeader h;
+        memcpy(h.magic, HISTORY_MAGIC, 4);
+        h.version = HISTORY_VERSION;
+        fwrite(&h, sizeof(h), 1, fp);
+        fflush(fp);
+    }
+    return fp;
+}
+
+// Opens (creating if needed) a file that starts with a HistoryHeader. A
+// file in an older format is started over when creating is allowed.
+static FILE* openHistoryFile(const char* filename, const char* ext, int create) {
+    char path[256];
+    sidecarPath(path, sizeof(path), filename, ext);
+    FILE* fp = fopen(path, "r+b");
+    if (!fp) return create ? createHistoryFile(path) : NULL;
+
+    HistoryHeader h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, HISTORY_MAGIC, 4) != 0 || h.version != HISTORY_VERSION) {
+        fclose(fp);
+        return create ? createHistoryFile(path) : NULL;
+    }
+    return fp;
+}
+
+// Treap priority derived from the id, so the shape of a version depends
+// only on its contents and stays balanced in expectation.
+static uint32_t priority(int id) {
+    uint32_t h = (uint32_t)id;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// On disk a node is its children's offsets followed by the row in the
+// sidecar row encoding (see encodeRow).
+#define NODE_MAX_BYTES (2 * 8 + ROW_MAX_BYTES)
+
+static int readNode(NodeFile* nf, long off, HistoryNode* n) {
+    if (off < (long)sizeof(HistoryHeader) || off + 2 * 8 + ROW_FIXED_BYTES > nf->size) return 0;
+    unsigned char buf[NODE_MAX_BYTES];
+    fseek(nf->fp, off, SEEK_SET);
+    size_t got = fread(buf, 1, sizeof(buf), nf->fp);
+    if (got < 2 * 8 + ROW_FIXED_BYTES) return 0;
+
+    int64_t links[2];
+    memcpy(links, buf, sizeof(links));
+    n->left = (long)links[0];
+    n->right = (long)links[1];
+    const unsigned char* p = buf + sizeof(links);
+    return decodeRow(&p, buf + got, &n->data);
+}
+
+static long writeNode(NodeFile* nf, const Transaction* t, long left, long right) {
+    unsigned char buf[NODE_MAX_BYTES];
+    int64_t links[2] = {left, right};
+    memcpy(buf, links, sizeof(links));
+    size_t len = sizeof(links) + encodeRow(buf + sizeof(links), t);
+
+    long off = nf->size;
+    fseek(nf->fp, off, SEEK_SET);
+    if (fwrite(buf, 1, len, nf->fp) != len) return 0;
+    nf->size += (long)len;
+    return off;
+}
+
+// Splits into ids < key and ids >= key, copying only the nodes on the path.
+static void split(NodeFile* nf, long off, int key, long* left, long* right) {
+    HistoryNode n;
+    if (!readNode(nf, off, &n)) {
+        *left = *right = 0;
+        return;
+    }
+    if (n.data.id < key) {
+        long l, r;
+        split(nf, n.right, key, &l, &r);
+        *left = writeNode(nf, &n.data, n.left, l);
+        *right = r;
+    } else {
+        long l, r;
+        split(nf, n.left, key, &l, &r);
+        *left = l;
+        *right = writeNode(nf, &n.data, r, n.right);
+    }
+}
+
+static long merge(NodeFile* nf, long a, long b) {
+    HistoryNode na, nb;
+    if (!readNode(nf, a, &na)) return b;
+    if (!readNode(nf, b, &nb)) return a;
+    if (priority(na.data.id) > priority(nb.data.id)) {
+        return writeNode(nf, &na.data, na.left, merge(nf, na.right, b));
+    }
+    return writeNode(nf, &nb.data, merge(nf, a, nb.left), nb.right);
+}
+
+static long insertNode(NodeFile* nf, long off, const Transaction* t) {
+    HistoryNode n;
+    if (!readNode(nf, off, &n)) return writeNode(nf, t, 0, 0);
+    if (priority(t->id) > priority(n.data.id)) {
+        long l, r;
+        split(nf, off, t->id, &l, &r);
+        return writeNode(nf, t, l, r);
+    }
+    if (t->id < n.data.id) return writeNode(nf, &n.data, insertNode(nf, n.left, t), n.right);
+    return writeNode(nf, &n.data, n.left, insertNode(nf, n.right, t));
+}
+
+static long removeNode(NodeFile* nf, long off, int id) {
+    HistoryNode n;
+    if (!readNode(nf, off, &n)) return off;
+    if (n.data.id == id) return merge(nf, n.left, n.right);
+    if (id < n.data.id) {
+        long left = removeNode(nf, n.left, id);
+        return left == n.left ? off : writeNode(nf, &n.data, left, n.right);
+    }
+    long right = removeNode(nf, n.right, id);
+    return right == n.right ? off : writeNode(nf, &n.data, n.left, right);
+}
+
+static int openNodes(NodeFile* nf, const char* filename, int create) {
+    nf->fp = openHistoryFile(filename, "history", create);
+    if (!nf->fp) return 0;
+    fseek(nf->fp, 0, SEEK_END);
+    nf->size = ftell(nf->fp);
+    return 1;
+}
+
+static long versionCount(FILE* fp) {
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp) - (long)sizeof(HistoryHeader);
+    return size > 0 ? size / (long)sizeof(VersionRecord) : 0;
+}
+
+static int readVersion(FILE* fp, long version, VersionRecord* rec) {
+    fseek(fp, sizeof(HistoryHeader) + (version - 1) * sizeof(VersionRecord), SEEK_SET);
+    return fread(rec, sizeof(VersionRecord), 1, fp) == 1;
+}
+
+static long appendVersion(const char* filename, VersionRecord* rec) {
+    FILE* fp = openHistoryFile(filename, "versions", 1);
+    if (!fp) return 0;
+    rec->version = versionCount(fp) + 1;
+    rec->timestamp = (long)time(NULL);
+    // Drop any torn record left by a crash before appending.
+    fseek(fp, sizeof(HistoryHeader) + (rec->version - 1) * sizeof(VersionRecord), SEEK_SET);
+    int ok = fwrite(rec, sizeof(VersionRecord), 1, fp) == 1;
+    fclose(fp);
+    return ok ? rec->version : 0;
+}
+
+long latestVersion(const char* filename, VersionRecord* rec) {
+    FILE* fp = openHistoryFile(filename, "versions", 0);
+    if (!fp) return 0;
+    long n = versionCount(fp);
+    if (n > 0 && !readVersion(fp, n, rec)) n = 0;
+    fclose(fp);
+    return n;
+}
+
+int findVersion(const char* filename, long version, VersionRecord* rec) {
+    FILE* fp = openHistoryFile(filename, "versions", 0);
+    if (!fp) return 0;
+    int ok = version >= 1 && version <= versionCount(fp) && readVersion(fp, version, rec);
+    fclose(fp);
+    return ok;
+}
+
+// Latest version made at or before 'when'; timestamps only ever grow.
+int findVersionAt(const char* filename, long when, VersionRecord* rec) {
+    FILE* fp = openHistoryFile(filename, "versions", 0);
+    if (!fp) return 0;
+    long lo = 1, hi = versionCount(fp), found = 0;
+    VersionRecord r;
+    while (lo <= hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (!readVersion(fp, mid, &r)) break;
+        if (r.timestamp <= when) {
+            found = mid;
+            *rec = r;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    fclose(fp);
+    return found > 0;
+}
+
+static int compareById(const void* a, const void* b) {
+    const Transaction* ta = (const Transaction*)a;
+    const Transaction* tb = (const Transaction*)b;
+    return (ta->id > tb->id) - (ta->id < tb->id);
+}
+
+static long writeSubtree(NodeFile* nf, const Transaction* rows, const int* left, const int* right, int i) {
+    if (i < 0) return 0;
+    long l = writeSubtree(nf, rows, left, right, left[i]);
+    long r = writeSubtree(nf, rows, left, right, right[i]);
+    return writeNode(nf, &rows[i], l, r);
+}
+
+// Builds a whole version at once: sort by id, link the treap with a stack
+// in O(n), then write each node exactly once, children first.
+static long writeBase(NodeFile* nf, AppState* s) {
+    int n = 0;
+    Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * (s->count + 1));
+    for (Node* temp = s->head; temp != NULL && n < s->count; temp = temp->next) rows[n++] = temp->data;
+    qsort(rows, n, sizeof(Transaction), compareById);
+
+    int* left = (int*)malloc(sizeof(int) * (n + 1));
+    int* right = (int*)malloc(sizeof(int) * (n + 1));
+    int* stack = (int*)malloc(sizeof(int) * (n + 1));
+    int top = 0;
+    for (int i = 0; i < n; i++) {
+        int last = -1;
+        while (top > 0 && priority(rows[stack[top - 1]].id) < priority(rows[i].id)) last = stack[--top];
+        left[i] = last;
+        right[i] = -1;
+        if (top > 0) right[stack[top - 1]] = i;
+        stack[top++] = i;
+    }
+    long root = writeSubtree(nf, rows, left, right, top > 0 ? stack[0] : -1);
+    free(rows);
+    free(left);
+    free(right);
+    free(stack);
+    return root;
+}
+
+static void finishVersion(AppState* s, VersionRecord* rec, uint64_t digest) {
+    rec->count = s->count;
+    rec->totalIncome = s->totalIncome;
+    rec->totalExpense = s->totalExpense;
+    rec->digest = digest;
+    appendVersion(s->filename, rec);
+}
+
+// Called after each change to the current state. The tip's digest with
+// the change applied must match the current rows; otherwise (first change,
+// or a change the history never saw) the whole current state is recorded
+// as a new base instead.
+void versionsOnChange(AppState* s, char op, const Transaction* t) {
+    VersionRecord tip;
+    long tipVersion = latestVersion(s->filename, &tip);
+    uint64_t digest = s->digest;
+
+    NodeFile nf;
+    if (!openNodes(&nf, s->filename, 1)) return;
+
+    VersionRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    if (!tipVersion || (tip.digest ^ rowDigest(t)) != digest) {
+        rec.root = writeBase(&nf, s);
+        rec.op = VERSION_BASE;
+    } else {
+        rec.root = op == VERSION_ADD ? insertNode(&nf, tip.root, t) : removeNode(&nf, tip.root, t->id);
+        rec.op = op;
+        rec.id = t->id;
+    }
+    fclose(nf.fp);
+    finishVersion(s, &rec, digest);
+}
+
+// One version for a whole bulk change. Path copying costs O(log n) nodes
+// per row, so past a quarter of the rows a fresh base is cheaper.
+void versionsOnBulk(AppState* s, const Transaction* removed, int nRemoved, const Transaction* added, int nAdded) {
+    VersionRecord tip;
+    long tipVersion = latestVersion(s->filename, &tip);
+    uint64_t digest = s->digest;
+    uint64_t expected = tipVersion ? tip.digest : 0;
+    for (int i = 0; i < nRemoved; i++) expected ^= rowDigest(&removed[i]);
+    for (int i = 0; i < nAdded; i++) expected ^= rowDigest(&added[i]);
+
+    NodeFile nf;
+    if (!openNodes(&nf, s->filename, 1)) return;
+
+    VersionRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.op = VERSION_BULK;
+    rec.id = nRemoved + nAdded;
+    if (!tipVersion || expected != digest) {
+        rec.root = writeBase(&nf, s);
+        rec.op = VERSION_BASE;
+    } else if ((long)(nRemoved + nAdded) * 4 > s->count) {
+        rec.root = writeBase(&nf, s);
+    } else {
+        rec.root = tip.root;
+        for (int i = 0; i < nRemoved; i++) rec.root = removeNode(&nf, rec.root, removed[i].id);
+        for (int i = 0; i < nAdded; i++) rec.root = insertNode(&nf, rec.root, &added[i]);
+    }
+    fclose(nf.fp);
+    finishVersion(s, &rec, digest);
+}
+
+static void collectRows(NodeFile* nf, long off, Transaction* rows, int* n, int max) {
+    HistoryNode node;
+    while (*n < max && readNode(nf, off, &node)) {
+        collectRows(nf, node.left, rows, n, max);
+        if (*n < max) rows[(*n)++] = node.data;
+        off = node.right;
+    }
+}
+
+// Rows of a version in id order; the caller frees *rows. Returns -1 if the
+// history cannot be read.
+int versionRows(const char* filename, const VersionRecord* rec, Transaction** rows) {
+    NodeFile nf;
+    *rows = NULL;
+    if (!openNodes(&nf, filename, 0)) return -1;
+    static char ioBuf[65536];
+    setvbuf(nf.fp, ioBuf, _IOFBF, sizeof(ioBuf));
+
+    int n = 0;
+    *rows = (Transaction*)malloc(sizeof(Transaction) * (rec->count > 0 ? rec->count : 1));
+    collectRows(&nf, rec->root, *rows, &n, rec->count);
+    fclose(nf.fp);
+    return n;
+}
+
+long appendRollback(const char* filename, const VersionRecord* target) {
+    VersionRecord rec = *target;
+    rec.op = VERSION_ROLLBACK;
+    rec.id = (int)target->version;
+    return appendVersion(filename, &rec);
+}
+
+void displayVersions(const char* filename, int n) {
+    FILE* fp = openHistoryFile(filename, "versions", 0);
+    long total = fp ? versionCount(fp) : 0;
+    if (total == 0) {
+        printf("No version history yet.\n");
+        if (fp) fclose(fp);
+        return;
+    }
+
+    printf("\n%-8s %-20s %-10s %-8s %-12s %-12s\n", "Version", "Time", "Change", "Rows", "Income", "Expense");
+    printf("--------------------------------------------------------------------------\n");
+    VersionRecord rec;
+    for (long v = total; v >= 1 && v > total - n; v--) {
+        if (!readVersion(fp, v, &rec)) break;
+        char when[32], change[16];
+        time_t ts = (time_t)rec.timestamp;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&ts));
+        if (rec.op == VERSION_ADD) snprintf(change, sizeof(change), "add %d", rec.id);
+        else if (rec.op == VERSION_DELETE) snprintf(change, sizeof(change), "delete %d", rec.id);
+        else if (rec.op == VERSION_ROLLBACK) snprintf(change, sizeof(change), "to v%d", rec.id);
+        else if (rec.op == VERSION_BULK) snprintf(change, sizeof(change), "bulk %d", rec.id);
+        else snprintf(change, sizeof(change), "base");
+        printf("%-8ld %-20s %-10s %-8d %-12.2f %-12.2f\n", rec.version, when, change, rec.count, rec.totalIncome, rec.totalExpense);
+    }
+    printf("--------------------------------------------------------------------------\n");
+    fclose(fp);
+}
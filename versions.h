@@ -0,0 +1,47 @@
+#ifndef VERSIONS_H
+#define VERSIONS_H
+
+#include "common.h"
+#include "appstate.h"
+#include "output.h"
+#include <stdint.h>
+
+#define HISTORY_MAGIC "EXPH"
+#define HISTORY_VERSION 3
+
+#define VERSION_BASE 'B'
+#define VERSION_ADD 'A'
+#define VERSION_DELETE 'D'
+#define VERSION_ROLLBACK 'R'
+#define VERSION_BULK 'M'
+
+// Every version of the account as a persistent treap keyed by id.
+// <file>.history is an append-only node file: a change copies only the
+// O(log n) nodes on its path and shares the rest with earlier versions.
+// The whole state is written only as a base: for the first change, and
+// when the tip no longer matches the rows (see AppState's digest).
+// <file>.versions is a table of fixed-size records, one per version,
+// pointing at that version's root. Reading an old version never copies the
+// dataset, and returning to one is a single new record.
+typedef struct {
+    long version;
+    long timestamp;
+    long root;
+    int count;
+    char op;
+    int id;         // transaction id, the target of a rollback, or rows in a bulk change
+    double totalIncome;
+    double totalExpense;
+    uint64_t digest;  // order-independent hash of the rows
+} VersionRecord;
+
+void versionsOnChange(AppState* s, char op, const Transaction* t);
+void versionsOnBulk(AppState* s, const Transaction* removed, int nRemoved, const Transaction* added, int nAdded);
+long latestVersion(const char* filename, VersionRecord* rec);
+int findVersion(const char* filename, long version, VersionRecord* rec);
+int findVersionAt(const char* filename, long when, VersionRecord* rec);
+int versionRows(const char* filename, const VersionRecord* rec, Transaction** rows);
+long appendRollback(const char* filename, const VersionRecord* target);
+void displayVersions(const char* filename, int n);
+
+#endif
@@ -0,0 +1,61 @@
+#include "views.h"
+
+int parseOrder(const char* name, int* order) {
+    if (strcmp(name, "stored") == 0) *order = ORDER_STORED;
+    else if (strcmp(name, "id") == 0) *order = ORDER_ID;
+    else if (strcmp(name, "amount") == 0) *order = ORDER_AMOUNT;
+    else if (strcmp(name, "date") == 0) *order = ORDER_DATE;
+    else return 0;
+    return 1;
+}
+
+double viewKey(const Transaction* t, int order) {
+    if (order == ORDER_AMOUNT) return t->amount;
+    if (order == ORDER_DATE) return t->date.year * 10000 + t->date.month * 100 + t->date.day;
+    return t->id;
+}
+
+static int entryBefore(const ViewEntry* e, double key, int id) {
+    return e->key < key || (e->key == key && e->id < id);
+}
+
+// First position whose entry is not before (key, id).
+static int lowerBound(const SortedView* v, double key, int id) {
+    int lo = 0, hi = v->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (entryBefore(&v->entries[mid], key, id)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void viewInsert(SortedView* v, double key, int id) {
+    if (v->count == v->capacity) {
+        int capacity = v->capacity ? v->capacity * 2 : 64;
+        ViewEntry* grown = (ViewEntry*)realloc(v->entries, sizeof(ViewEntry) * capacity);
+        if (!grown) return;
+        v->entries = grown;
+        v->capacity = capacity;
+    }
+    int pos = lowerBound(v, key, id);
+    memmove(&v->entries[pos + 1], &v->entries[pos], sizeof(ViewEntry) * (v->count - pos));
+    v->entries[pos].key = key;
+    v->entries[pos].id = id;
+    v->count++;
+}
+
+void viewRemove(SortedView* v, double key, int id) {
+    int pos = lowerBound(v, key, id);
+    if (pos < v->count && v->entries[pos].key == key && v->entries[pos].id == id) {
+        memmove(&v->entries[pos], &v->entries[pos + 1], sizeof(ViewEntry) * (v->count - pos - 1));
+        v->count--;
+    }
+}
+
+void freeView(SortedView* v) {
+    free(v->entries);
+    v->entries = NULL;
+    v->count = 0;
+    v->capacity = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef VIEWS_H
+#define VIEWS_H
+
+#include "common.h"
+
+#define ORDER_STORED 0
+#define ORDER_ID 1
+#define ORDER_AMOUNT 2
+#define ORDER_DATE 3
+
+typedef struct {
+    double key;
+    int id;
+} ViewEntry;
+
+// Ids kept sorted by (key, id). Ties fall back to id, which keeps the
+// order stable with respect to insertion.
+typedef struct {
+    ViewEntry* entries;
+    int count;
+    int capacity;
+} SortedView;
+
+int parseOrder(const char* name, int* order);
+double viewKey(const Transaction* t, int order);
+void viewInsert(SortedView* v, double key, int id);
+void viewRemove(SortedView* v, double key, int id);
+void freeView(SortedView* v);
+
+#endif
@@ -0,0 +1,177 @@
+#include "viewstore.h"
+#include "file_ops.h"
+#include "writebehind.h"
+
+typedef struct {
+    char magic[4];
+    int version;
+    long generation;
+    long dataSize;
+    int count;
+} ViewsHeader;
+
+static const Transaction* sortRows;
+static int sortOrder;
+
+static int compareRows(const void* a, const void* b) {
+    const Transaction* ta = &sortRows[*(const int*)a];
+    const Transaction* tb = &sortRows[*(const int*)b];
+    double ka = viewKey(ta, sortOrder);
+    double kb = viewKey(tb, sortOrder);
+    if (ka < kb) return -1;
+    if (ka > kb) return 1;
+    return ta->id - tb->id;
+}
+
+static void fillView(SortedView* v, const Transaction* rows, int* idx, int n, int order) {
+    freeView(v);
+    v->entries = (ViewEntry*)malloc(sizeof(ViewEntry) * (n > 0 ? n : 1));
+    v->capacity = n > 0 ? n : 1;
+    for (int i = 0; i < n; i++) idx[i] = i;
+    sortRows = rows;
+    sortOrder = order;
+    qsort(idx, n, sizeof(int), compareRows);
+    for (int i = 0; i < n; i++) {
+        v->entries[i].key = viewKey(&rows[idx[i]], order);
+        v->entries[i].id = rows[idx[i]].id;
+    }
+    v->count = n;
+}
+
+void rebuildViews(AppState* s) {
+    int n = 0;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) n++;
+
+    Transaction* rows = (Transaction*)malloc(sizeof(Transaction) * (n + 1));
+    int* idx = (int*)malloc(sizeof(int) * (n + 1));
+    int i = 0;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) rows[i++] = temp->data;
+
+    fillView(&s->amountView, rows, idx, n, ORDER_AMOUNT);
+    fillView(&s->dateView, rows, idx, n, ORDER_DATE);
+    free(rows);
+    free(idx);
+}
+
+static int readView(FILE* fp, SortedView* v, int count) {
+    freeView(v);
+    v->entries = (ViewEntry*)malloc(sizeof(ViewEntry) * (count > 0 ? count : 1));
+    v->capacity = count > 0 ? count : 1;
+    if (!v->entries || fread(v->entries, sizeof(ViewEntry), count, fp) != (size_t)count) {
+        freeView(v);
+        return 0;
+    }
+    v->count = count;
+    return 1;
+}
+
+// Valid only if written at the current generation against a data file of
+// the current size; anything else means the views are stale.
+int loadViews(AppState* s) {
+    char path[256];
+    sidecarPath(path, sizeof(path), s->filename, "views");
+
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    ViewsHeader h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, VIEWS_MAGIC, 4) == 0 &&
+             h.version == VIEWS_VERSION &&
+             h.generation == s->generation &&
+             h.dataSize == fileSize(s->filename) &&
+             h.count == s->count;
+    ok = ok && readView(fp, &s->amountView, h.count) && readView(fp, &s->dateView, h.count);
+    fclose(fp);
+
+    if (!ok) {
+        freeView(&s->amountView);
+        freeView(&s->dateView);
+    }
+    return ok;
+}
+
+void saveViews(AppState* s) {
+    char path[256], tmpPath[256];
+    sidecarPath(path, sizeof(path), s->filename, "views");
+
+    ViewsHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, VIEWS_MAGIC, 4);
+    h.version = VIEWS_VERSION;
+    h.generation = s->generation;
+    h.dataSize = fileSize(s->filename);
+    h.count = s->amountView.count;
+
+    FILE* fp = openForReplace(path, "wb", tmpPath, sizeof(tmpPath));
+    if (!fp) return;
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(s->amountView.entries, sizeof(ViewEntry), s->amountView.count, fp);
+    fwrite(s->dateView.entries, sizeof(ViewEntry), s->dateView.count, fp);
+    commitReplace(fp, tmpPath, path);
+}
+
+void viewsOnAdd(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_VIEWS)) return;
+    viewInsert(&s->amountView, viewKey(t, ORDER_AMOUNT), t->id);
+    viewInsert(&s->dateView, viewKey(t, ORDER_DATE), t->id);
+    if (!deferSave(s, DIRTY_VIEWS)) saveViews(s);
+}
+
+void viewsOnDelete(AppState* s, const Transaction* t) {
+    if (!isLoaded(s, NEED_VIEWS)) return;
+    viewRemove(&s->amountView, viewKey(t, ORDER_AMOUNT), t->id);
+    viewRemove(&s->dateView, viewKey(t, ORDER_DATE), t->id);
+    if (!deferSave(s, DIRTY_VIEWS)) saveViews(s);
+}
+
+typedef struct {
+    int id;
+    const Transaction* row;
+} RowRef;
+
+static int compareRefs(const void* a, const void* b) {
+    int x = ((const RowRef*)a)->id, y = ((const RowRef*)b)->id;
+    return (x > y) - (x < y);
+}
+
+void writeOrdered(AppState* s, int order, OutputWriter* w) {
+    w->order = order;
+    if ((order == ORDER_AMOUNT || order == ORDER_DATE) && w->cursorGone && !w->keyed) {
+        printf("Error: Transaction %d no longer exists; resume with the --after=KEY:ID cursor from the last page.\n", w->after);
+        return;
+    }
+    if (order == ORDER_STORED) {
+        writeList(s->head, w);
+        return;
+    }
+
+    // Rows sorted by id, sized by the row count rather than the largest id.
+    int n = 0;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) n++;
+    RowRef* byId = (RowRef*)malloc(sizeof(RowRef) * (n + 1));
+    if (!byId) {
+        printf("Error: Out of memory listing %d transactions.\n", n);
+        return;
+    }
+    n = 0;
+    for (Node* temp = s->head; temp != NULL; temp = temp->next) {
+        byId[n].id = temp->data.id;
+        byId[n++].row = &temp->data;
+    }
+    qsort(byId, n, sizeof(RowRef), compareRefs);
+
+    outBeginList(w, "transactions", ROW_TABLE);
+    if (order == ORDER_ID) {
+        for (int i = 0; i < n && outTransaction(w, byId[i].row); i++);
+    } else {
+        SortedView* v = order == ORDER_AMOUNT ? &s->amountView : &s->dateView;
+        for (int i = 0; i < v->count; i++) {
+            RowRef key = {v->entries[i].id, NULL};
+            RowRef* found = (RowRef*)bsearch(&key, byId, n, sizeof(RowRef), compareRefs);
+            if (found && !outTransaction(w, found->row)) break;
+        }
+    }
+    outEndList(w, "No transactions found.");
+    free(byId);
+}
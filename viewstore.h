@@ -0,0 +1,21 @@
+#ifndef VIEWSTORE_H
+#define VIEWSTORE_H
+
+#include "common.h"
+#include "appstate.h"
+#include "output.h"
+
+#define VIEWS_MAGIC "EXPV"
+#define VIEWS_VERSION 1
+
+// Amount and date orderings persisted in <file>.views and kept current by
+// every add/delete, so listing in another order is a read, not a re-sort
+// and rewrite of the data file.
+int loadViews(AppState* s);
+void rebuildViews(AppState* s);
+void saveViews(AppState* s);
+void viewsOnAdd(AppState* s, const Transaction* t);
+void viewsOnDelete(AppState* s, const Transaction* t);
+void writeOrdered(AppState* s, int order, OutputWriter* w);
+
+#endif
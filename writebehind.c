@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime, sigwait, pthread_sigmask
+#include "writebehind.h"
+#include "file_ops.h"
+#include "snapshot.h"
+#include "viewstore.h"
+#include "budget.h"
+#include "sketch.h"
+#include "lock.h"
+#include "cache.h"
+
+static int sessionLock = -1;
+static long sessionGen = -1;
+
+static void releaseSession(void) {
+    releaseLock(sessionLock);
+    sessionLock = -1;
+}
+
+#ifdef _WIN32
+
+// No worker on Windows: saves are deferred only inside a batch.
+int startWriteBehind(AppState* s, int maxStaleMs) {
+    (void)s;
+    (void)maxStaleMs;
+    return 0;
+}
+
+void stopWriteBehind(AppState* s) {
+    (void)s;
+}
+
+void writeBehindLock(void) {}
+void writeBehindUnlock(void) {}
+
+int deferSave(AppState* s, int what) {
+    if (!s->deferSaves) return 0;
+    s->dirty |= what;
+    return 1;
+}
+
+static void flushDirty(AppState* s, int keepLocked) {
+    (void)keepLocked;
+    int dirty = s->dirty;
+    s->dirty = 0;
+    if (dirty & DIRTY_UNDO) saveStack(s->undoStack, "undo_stack.txt");
+    if (dirty & DIRTY_RECURRING) saveQueue(s->recurringQueue, "recurring.txt");
+    if (dirty & DIRTY_DATA) saveToFile(s->head, s->filename);
+    if (dirty & DIRTY_VIEWS) saveViews(s);
+    if (dirty & DIRTY_BUDGETS) saveBudgets(s);
+    if (dirty & DIRTY_SKETCHES) saveSketches(s);
+    if (dirty & DIRTY_FINGERPRINTS) saveFingerprints(s);
+}
+
+#else
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+static pthread_mutex_t stateMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t worker;
+static pthread_t signalWatcher;
+static AppState* owner = NULL;
+static int running = 0;
+static int staleMs = DEFAULT_WRITE_BEHIND_MS;
+static struct timespec firstDirty;
+static pthread_cond_t saveDone = PTHREAD_COND_INITIALIZER;
+static int saving = 0;
+
+void writeBehindLock(void) {
+    if (running) pthread_mutex_lock(&stateMutex);
+}
+
+void writeBehindUnlock(void) {
+    if (running) pthread_mutex_unlock(&stateMutex);
+}
+
+// Called with stateMutex held, from inside a mutation.
+int deferSave(AppState* s, int what) {
+    if (!s->deferSaves) return 0;
+    if (!s->dirty && running) {
+        clock_gettime(CLOCK_REALTIME, &firstDirty);
+        pthread_cond_signal(&wake);
+    }
+    s->dirty |= what;
+    return 1;
+}
+
+// Called with stateMutex held. The data file is written from a copy of the
+// rows with the mutex released, so the prompt only waits for the copy;
+// 'saving' is set meanwhile so no other flush starts a save of its own.
+// Sidecars record the data file's size, so they are written after it.
+static void flushDirty(AppState* s, int keepLocked) {
+    int dirty = s->dirty;
+    s->dirty = 0;
+    if (!dirty) return;
+
+    Transaction* rows = NULL;
+    int n = 0;
+    if (dirty & DIRTY_DATA) {
+        rows = (Transaction*)malloc(sizeof(Transaction) * (s->count + 1));
+        for (Node* temp = s->head; temp != NULL && n < s->count; temp = temp->next) rows[n++] = temp->data;
+    }
+    if (dirty & DIRTY_UNDO) saveStack(s->undoStack, "undo_stack.txt");
+    if (dirty & DIRTY_RECURRING) saveQueue(s->recurringQueue, "recurring.txt");
+
+    if (rows) {
+        saving = !keepLocked;
+        if (!keepLocked) pthread_mutex_unlock(&stateMutex);
+        saveRowsToFile(rows, n, s->filename);
+        free(rows);
+        if (!keepLocked) pthread_mutex_lock(&stateMutex);
+        saving = 0;
+        pthread_cond_broadcast(&saveDone);
+    }
+
+    if (dirty & DIRTY_VIEWS) saveViews(s);
+    if (dirty & DIRTY_BUDGETS) saveBudgets(s);
+    if (dirty & DIRTY_SKETCHES) saveSketches(s);
+    if (dirty & DIRTY_FINGERPRINTS) saveFingerprints(s);
+}
+
+static void* writeBehindMain(void* arg) {
+    AppState* s = (AppState*)arg;
+    pthread_mutex_lock(&stateMutex);
+    while (running) {
+        if (!s->dirty) {
+            pthread_cond_wait(&wake, &stateMutex);
+            continue;
+        }
+        // Let further changes within the window share this write.
+        struct timespec deadline = firstDirty;
+        deadline.tv_sec += staleMs / 1000;
+        deadline.tv_nsec += (long)(staleMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (running && pthread_cond_timedwait(&wake, &stateMutex, &deadline) == 0);
+        if (running) flushDirty(s, 0);
+        // The account lock was kept for these saves; other processes may go now.
+        if (running && !s->dirty && sessionLock >= 0) releaseSession();
+    }
+    pthread_mutex_unlock(&stateMutex);
+    return NULL;
+}
+
+// Pending saves imply the session still holds the account lock.
+static void finalFlush(AppState* s) {
+    while (saving) pthread_cond_wait(&saveDone, &stateMutex);
+    s->deferSaves = 0;
+    if (sessionLock < 0) return;
+    flushDirty(s, 1);
+    if (isLoaded(s, NEED_TRANSACTIONS)) writeSnapshot(s);
+    releaseSession();
+}
+
+// Signals are blocked in every thread and taken here, so an interrupted
+// session still gets its final flush (after any mutation in progress).
+static void* signalWatcherMain(void* arg) {
+    sigset_t* set = (sigset_t*)arg;
+    int sig;
+    if (sigwait(set, &sig) != 0) return NULL;
+    pthread_mutex_lock(&stateMutex);
+    running = 0;
+    if (owner) finalFlush(owner);
+    fflush(stdout);
+    _exit(128 + sig);
+    return NULL;
+}
+
+int startWriteBehind(AppState* s, int maxStaleMs) {
+    static sigset_t signals;
+    if (running || maxStaleMs <= 0) return 0;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    owner = s;
+    staleMs = maxStaleMs;
+    s->dirty = 0;
+    s->deferSaves = 1;
+    running = 1;
+    if (pthread_create(&worker, NULL, writeBehindMain, s) != 0) {
+        running = 0;
+        s->deferSaves = 0;
+        pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+        return 0;
+    }
+    pthread_create(&signalWatcher, NULL, signalWatcherMain, &signals);
+    return 1;
+}
+
+void stopWriteBehind(AppState* s) {
+    if (!running) return;
+    pthread_mutex_lock(&stateMutex);
+    running = 0;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&stateMutex);
+    pthread_join(worker, NULL);
+
+    pthread_mutex_lock(&stateMutex);
+    finalFlush(s);
+    owner = NULL;
+    pthread_mutex_unlock(&stateMutex);
+}
+
+#endif
+
+// Outside a write-behind session the batch is flushed by endBatch; inside
+// one, the worker picks it up as usual.
+int beginBatch(AppState* s) {
+    int wasDeferred = s->deferSaves;
+    s->deferSaves = 1;
+    return wasDeferred;
+}
+
+void endBatch(AppState* s, int wasDeferred) {
+    s->deferSaves = wasDeferred;
+    if (!wasDeferred) flushDirty(s, 1);
+}
+
+// The lock is taken when the session does not already hold it; anything
+// another process wrote since the last command is then reloaded.
+void sessionBegin(AppState* s, int mode) {
+    writeBehindLock();
+    if (sessionLock >= 0) return;
+    writeBehindUnlock();
+    int lock = acquireLock(s->filename, mode);
+    writeBehindLock();
+    sessionLock = lock;
+
+    long gen = dataGeneration(s->filename);
+    if (gen != sessionGen) {
+        int deferSaves = s->deferSaves;
+        freeAppState(s);
+        initAppState(s, s->filename);
+        s->deferSaves = deferSaves;
+        ensureLoaded(s, NEED_ALL);
+        sessionGen = gen;
+    }
+}
+
+void sessionEnd(AppState* s, int changed) {
+    if (changed) sessionGen = bumpDataGeneration(s->filename);
+    if (!s->dirty && sessionLock >= 0) releaseSession();
+    writeBehindUnlock();
+}
@@ -0,0 +1,47 @@
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+
+#include "common.h"
+#include "appstate.h"
+
+#define DEFAULT_WRITE_BEHIND_MS 200
+
+#define DIRTY_DATA 1
+#define DIRTY_UNDO 2
+#define DIRTY_RECURRING 4
+#define DIRTY_VIEWS 8
+#define DIRTY_BUDGETS 16
+#define DIRTY_SKETCHES 32
+#define DIRTY_FINGERPRINTS 64
+
+// Write-behind for long-lived sessions. While a worker is running, the
+// full-file rewrites (data file, undo stack, recurring queue, views,
+// budgets, sketches) are only marked dirty; the worker coalesces them and
+// writes at most maxStaleMs after the first change. Journal and history
+// appends stay synchronous. Mutations must run between writeBehindLock()
+// and writeBehindUnlock() (or the session calls below). stopWriteBehind() (or SIGINT/SIGTERM/SIGHUP)
+// flushes everything and checkpoints.
+int startWriteBehind(AppState* s, int maxStaleMs);
+void stopWriteBehind(AppState* s);
+void writeBehindLock(void);
+void writeBehindUnlock(void);
+
+// Per-command account locking for the interactive session. Each command
+// runs between sessionBegin() and sessionEnd() (which also take the write-
+// behind mutex). The lock is released at sessionEnd() unless saves are
+// still pending, in which case the worker releases it once they are
+// written, so an idle session never blocks other processes. 'changed'
+// bumps the data generation for result caches.
+void sessionBegin(AppState* s, int mode);
+void sessionEnd(AppState* s, int changed);
+
+// Returns 1 if the save was deferred, 0 if the caller should save now.
+int deferSave(AppState* s, int what);
+
+// Bulk changes: saves requested between the two are written once, by
+// endBatch() (or by the worker, if one is running). Pass endBatch() the
+// value beginBatch() returned.
+int beginBatch(AppState* s);
+void endBatch(AppState* s, int wasDeferred);
+
+#endif